@@ -3,14 +3,21 @@
 #include <fstream>
 #include <algorithm>
 #include <span>
+#include <filesystem>
+#include <cstring>
 
 #include "Bus.h"
 #include "definitions.h"
 #include "PPU.h"
+#include "CPU.h"
 
 using namespace std;
 
-Bus::Bus(CPU* cpu, PPU* ppu, Display* display) : ppu{ ppu }, cpu{ cpu }, display{ display } {
+string savePathFor(const string& romPath) {
+	return filesystem::path(romPath).replace_extension(".sav").string();
+}
+
+Bus::Bus(CPU* cpu, PPU* ppu, Display* display) : cpu{ cpu }, ppu{ ppu }, display{ display } {
 	/*ifstream bootstrapStream("BootstrapROM.bin", ios::binary);
 	vector<u8> bootstrap((istreambuf_iterator<char>(bootstrapStream)), istreambuf_iterator<char>());
 
@@ -30,52 +37,205 @@ Bus::Bus(CPU* cpu, PPU* ppu, Display* display) : ppu{ ppu }, cpu{ cpu }, display
 	//const string inputFile = "Tetris (World).gb";
 	//const string inputFile = "Dr. Mario (World).gb";
 
+	loadRom(RomRegistry::open(inputFile), savePathFor(inputFile));
+	registerPorts();
+}
 
-	ifstream stream(inputFile, ios::binary);
-	vector<u8> contents((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
-	file = contents;
+// ROM file mapped through the registry, shared with every other Bus using it.
+// Battery RAM is kept in a .sav file next to it.
+Bus::Bus(CPU* cpu, PPU* ppu, Display* display, const string& romPath) : cpu{ cpu }, ppu{ ppu }, display{ display } {
+	loadRom(RomRegistry::open(romPath), savePathFor(romPath));
+	registerPorts();
+}
 
-	if (file.size() == 0) throw new exception("Error Reading File");
+// ROM image already in memory, e.g. a test program
+Bus::Bus(CPU* cpu, PPU* ppu, Display* display, const vector<u8>& rom) : cpu{ cpu }, ppu{ ppu }, display{ display } {
+	loadRom(RomRegistry::fromMemory(rom));
+	registerPorts();
+}
+
+// No memory or cartridge, every access goes to readSlow/writeSlow
+Bus::Bus(CPU* cpu) : cpu{ cpu }, ppu{ nullptr }, display{ nullptr } {
+	fill(begin(readPages), end(readPages), nullptr);
+	fill(begin(writePages), end(writePages), nullptr);
+}
+
+void Bus::loadRom(shared_ptr<const RomImage> rom, const string& savePath) {
+	cartridge.load(rom, savePath);
 	memory.resize(0x10000, 0);
-	memory.insert(memory.begin(), file.begin(), file.begin() + min(0x8000, (int)file.size()));
+	mapPages();
+}
+
+// One entry per 256-byte page: plain memory gets a host pointer, pages left
+// as nullptr are handled by readSlow() and writeSlow()
+void Bus::mapPages() {
+	u8* base = memory.data();
+	for (int page = 0x00; page <= 0xFF; page++) {
+		readPages[page] = base + (page << 8);
+		writePages[page] = base + (page << 8);
+	}
+	for (int page = 0x00; page <= 0x7F; page++) { // ROM, writes go to the MBC
+		writePages[page] = nullptr;
+	}
+	for (int page = 0xE0; page <= 0xFD; page++) { // Echo of C000-DDFF
+		readPages[page] = base + ((page - 0x20) << 8);
+		writePages[page] = nullptr;
+	}
+	readPages[0xD8] = writePages[0xD8] = nullptr; // 0xD800 hack
+	readPages[0xFF] = writePages[0xFF] = nullptr; // I/O, HRAM and IE
+	mapCartridge();
+}
+
+// ROM and external RAM pages point into the cartridge's current banks, so a
+// bank switch costs a few pointer stores and no copying. Writes to battery RAM
+// go through Cartridge::writeRam, which records what needs saving.
+void Bus::mapCartridge() {
+	const u8* bank0 = cartridge.romBankData(0x0000);
+	const u8* bank = cartridge.romBankData(0x4000);
+	u8* ram = cartridge.ramBankData();
+	if (ram != mappedRam) {
+		// Blocks decoded from the old bank don't describe the new one
+		for (u32 addr = 0xA000; addr <= 0xBFFF; addr += 16) {
+			if (cpu->isCode(addr)) cpu->invalidateCode(addr);
+		}
+		mappedRam = ram;
+	}
+	for (int page = 0x00; page < 0x40; page++) {
+		readPages[page] = bank0 + (page << 8);
+		readPages[0x40 + page] = bank + (page << 8);
+	}
+	for (int page = 0x00; page < 0x20; page++) {
+		readPages[0xA0 + page] = ram ? ram + (page << 8) : nullptr;
+		writePages[0xA0 + page] = (ram && !cartridge.tracksRamWrites()) ? ram + (page << 8) : nullptr;
+	}
 }
 
 span<u8> Bus::readRange(u16 addr, int length) {
 	return span(memory).subspan(addr, length);
 }
 
-u8 Bus::read(u16 addr) {
-	if (0 <= addr && addr <= 0x3FFF) { // Bank 0
-		return memory[addr];
+// Range around addr that read() serves straight from host memory: the mapped
+// ROM banks, WRAM and HRAM. Returns a pointer to the byte at start, or sets size to 0 if reads
+// at addr need to go through read(). The 0xD800 page is left out for the hack
+// in read(), and a bus without pages (see Bus(CPU*)) has no windows at all.
+const u8* Bus::fetchWindow(u16 addr, u16& start, u16& size) {
+	const u8* window;
+	if (addr <= 0x7FFF) {
+		start = addr & 0x4000;
+		size = 0x4000;
+		window = readPages[start >> 8];
 	}
-	else if (0x4000 <= addr && addr <= 0x7FFF) { // Switchable Bank 01..NN
-		return memory[addr];
+	else if (0xC000 <= addr && addr <= 0xD7FF) { start = 0xC000; size = 0x1800; window = readPages[0xC0]; }
+	else if (0xD900 <= addr && addr <= 0xDFFF) { start = 0xD900; size = 0x0700; window = readPages[0xD9]; }
+	else if (0xFF80 <= addr && addr <= 0xFFFE && !memory.empty()) { start = 0xFF80; size = 0x007F; window = memory.data() + start; }
+	else {
+		start = addr;
+		window = nullptr;
 	}
-	else if (0x8000 <= addr && addr <= 0x9FFF) { // Video RAM (VRAM)
-		return memory[addr];
+	if (window == nullptr) size = 0;
+	return window;
+}
+
+// The CPU and PPU register their own ports in attachBus
+void Bus::registerIO(u16 addr, IORead read, IOWrite write) {
+	ioReads[addr & 0x7F] = read;
+	ioWrites[addr & 0x7F] = write;
+}
+
+// Ports the bus handles itself
+void Bus::registerPorts() {
+	// Joypad, no buttons pressed
+	registerIO(0xFF00, [](u16) -> u8 { return 0x0F; }, nullptr);
+	// Serial, transfers are printed (blargg test results)
+	registerIO(0xFF02, nullptr, [this](u16, u8 val) {
+		if (val == 0x81) cout << memory[0xFF01] << flush;
+	});
+	// OAM DMA from val << 8
+	registerIO(0xFF46, nullptr, [this](u16, u8 val) { startOamDma(val); });
+}
+
+// The 160 bytes are copied to OAM straight away. The transfer still takes 160
+// M-cycles, during which the CPU can only reach I/O and HRAM.
+void Bus::startOamDma(u8 page) {
+	if (dmaActive) mapPages();
+
+	u8* oam = memory.data() + 0xFE00;
+	const u8* source = readPages[page];
+	if (source != nullptr) {
+		memcpy(oam, source, 160);
 	}
-	else if (0xA000 <= addr && addr <= 0xBFFF) { // External RAM
-		return memory[addr];
+	else {
+		for (int i = 0; i < 160; i++) oam[i] = read(page << 8 | i);
 	}
-	else if (0xC000 <= addr && addr <= 0xCFFF) { // Work RAM Bank 0 (WRAM)
-		return memory[addr];
+	for (u16 addr = 0xFE00; addr < 0xFEA0; addr += 16) markDirty(addr);
+
+	fill(begin(readPages), end(readPages), nullptr);
+	fill(begin(writePages), end(writePages), nullptr);
+	cpu->resetFetchWindow();
+	dmaActive = true;
+	dmaEnd = cpu->getCycles() + 160;
+}
+
+int Bus::subscribeDirty() {
+	dirtyViews.emplace_back();
+	dirtyViews.back().fill(~0ull);
+	return (int)dirtyViews.size() - 1;
+}
+
+// Hands the shared bits of the words covering the range to every subscriber
+void Bus::collectDirty(u16 start, u16 length) {
+	for (u32 word = start >> 10; word <= (u32)(start + length - 1) >> 10; word++) {
+		if (dirtyLines[word] == 0) continue;
+		for (auto& view : dirtyViews) view[word] |= dirtyLines[word];
+		dirtyLines[word] = 0;
 	}
-	else if (0xD000 <= addr && addr <= 0xDFFF) { // Work RAM Bank 1 (WRAM)
-		if (addr == 0xD800) return 0x1; // TODO: needed to pass blargg tests, why???? -> worked before :(
-		return memory[addr];
+}
+
+bool Bus::isDirty(int consumer, u16 start, u16 length) {
+	collectDirty(start, length);
+	const auto& lines = dirtyViews[consumer];
+	for (u32 line = start >> 4; line <= (u32)(start + length - 1) >> 4; line++) {
+		u64 word = lines[line >> 6];
+		if (word == 0) line |= 0x3F; // nothing in the rest of this word
+		else if (word >> (line & 0x3F) & 1) return true;
 	}
-	else if (0xE000 <= addr && addr <= 0xFDFF) { // Same as C000-DDFF (ECHO) (typically not used)
-		return memory[addr];
+	return false;
+}
+
+void Bus::clearDirty(int consumer, u16 start, u16 length) {
+	collectDirty(start, length);
+	auto& lines = dirtyViews[consumer];
+	for (u32 line = start >> 4; line <= (u32)(start + length - 1) >> 4; line++) {
+		lines[line >> 6] &= ~(1ull << (line & 0x3F));
 	}
-	else if (0xFE00 <= addr && addr <= 0xFE9F) { // Sprite Attribute Table (OAM)
-		return memory[addr];
+}
+
+// Maps the pages again once the CPU is past dmaEnd, returns true if it did
+bool Bus::endOamDma() {
+	if (cpu->getCycles() < dmaEnd) return false;
+	dmaActive = false;
+	mapPages();
+	cpu->resetFetchWindow();
+	return true;
+}
+
+// Addresses without a page, see read() in Bus.h
+u8 Bus::readSlow(u16 addr) {
+	if (dmaActive) {
+		if (endOamDma()) return read(addr);
+		if (addr < 0xFF00) return 0xFF;
+	}
+
+	if (0xA000 <= addr && addr <= 0xBFFF) { // External RAM, disabled or MBC3 clock
+		return cartridge.readRam(addr);
 	}
-	else if (0xFEA0 <= addr && addr <= 0xFEFF) { // Not Usable
+	else if (0xD800 <= addr && addr <= 0xD8FF) { // Work RAM Bank 1 (WRAM)
+		if (addr == 0xD800) return 0x1; // TODO: needed to pass blargg tests, why???? -> worked before :(
 		return memory[addr];
 	}
 	else if (0xFF00 <= addr && addr <= 0xFF7F) { // I/O Ports
-		if (addr == 0xFF00) return 0x0F;
-		return memory[addr];
+		const IORead& handler = ioReads[addr & 0x7F];
+		return handler ? handler(addr) : memory[addr];
 	}
 	else if (0xFF80 <= addr && addr <= 0xFFFE) { // High RAM (HRAM)
 		return memory[addr];
@@ -88,57 +248,45 @@ u8 Bus::read(u16 addr) {
 	}
 }
 
-void Bus::write(u16 addr, u8 val) {
-	if (0 <= addr && addr <= 0x3FFF) { // Bank 0
-		/*if (0x2000 <= addr && addr <= 0x3FFF) {
-			int bankNumber = addr & 0x1F;
-			memory.insert(memory.begin() + 0x4000, file.begin() + 0x4000 * bankNumber, file.begin() + 0x4000 * (bankNumber + 1));
-		}*/
-		/*else {
-			memory[addr] = val;
-		}*/
-	}
-	else if (0x4000 <= addr && addr <= 0x7FFF) { // Switchable Bank 01..NN
-		 //memory[addr] = val;
-	}
-	else if (0x8000 <= addr && addr <= 0x9FFF) { // Video RAM (VRAM)
-		memory[addr] = val;
+void Bus::writeSlow(u16 addr, u8 val) {
+	if (dmaActive) {
+		if (endOamDma()) {
+			write(addr, val);
+			return;
+		}
+		if (addr < 0xFF00) return;
 	}
-	else if (0xA000 <= addr && addr <= 0xBFFF) { // External RAM
-		memory[addr] = val;
+
+	if (0 <= addr && addr <= 0x7FFF) { // MBC registers
+		if (cartridge.write(addr, val)) {
+			mapCartridge();
+			cpu->resetFetchWindow();
+		}
 	}
-	else if (0xC000 <= addr && addr <= 0xCFFF) { // Work RAM Bank 0 (WRAM)
-		memory[addr] = val;
+	else if (0xA000 <= addr && addr <= 0xBFFF) { // External RAM, disabled or MBC3 clock
+		cartridge.writeRam(addr, val);
 	}
-	else if (0xD000 <= addr && addr <= 0xDFFF) { // Work RAM Bank 1 (WRAM)
+	else if (0xD800 <= addr && addr <= 0xD8FF) { // Work RAM Bank 1 (WRAM)
 		if (addr == 0xD800) {
 			cout << "test" << endl;
 		}
 		memory[addr] = val;
+		markDirty(addr);
 	}
 	else if (0xE000 <= addr && addr <= 0xFDFF) { // Same as C000-DDFF (ECHO) (typically not used)
-		memory[addr] = val;
-	}
-	else if (0xFE00 <= addr && addr <= 0xFE9F) { // Sprite Attribute Table (OAM)
-		memory[addr] = val;
-	}
-	else if (0xFEA0 <= addr && addr <= 0xFEFF) { // Not Usable
-		memory[addr] = val;
+		write(addr - 0x2000, val);
 	}
 	else if (0xFF00 <= addr && addr <= 0xFF7F) { // I/O Ports
-		if (addr != 0xFF00)
-			memory[addr] = val;
-		if (addr == 0xFF02 && val == 0x81)
-			cout << memory[0xFF01] << flush;
-		// if (addr == 0xFF01) cout << val << flush;
-		if (addr == 0xFF45) this->ppu->handleLycSet();
-		if (addr == 0xFF46) this->ppu->triggerDMA();
+		memory[addr] = val;
+		const IOWrite& handler = ioWrites[addr & 0x7F];
+		if (handler) handler(addr, val);
 	}
 	else if (0xFF80 <= addr && addr <= 0xFFFE) { // High RAM (HRAM)
 		memory[addr] = val;
 	}
 	else if (0xFFFF <= addr && addr <= 0xFFFF) { // Interupt Enable Register
 		memory[addr] = val;
+		cpu->setInterruptRegisters(val, memory[0xFF0F]);
 	}
 	else {
 		throw new exception("INVALID ADDRESS");
@@ -146,6 +294,6 @@ void Bus::write(u16 addr, u8 val) {
 	return;
 }
 
-void Bus::renderScanline(u8 row, std::vector<u8>* colours) {
+void Bus::renderScanline(u8 row, std::span<const u8> colours) {
 	this->display->drawScanline(row, colours);
 }
\ No newline at end of file
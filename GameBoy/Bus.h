@@ -2,25 +2,104 @@
 #include <string>
 #include <vector>
 #include <span>
+#include <memory>
+#include <array>
+#include <functional>
 
 #include "definitions.h"
+#include "Cartridge.h"
+#include "CPU.h"
 
 class PPU;
-class CPU;
+
+// Handlers for an I/O register (0xFF00-0xFF7F). Reads without a handler return
+// the stored value. Writes are always stored, then passed to the handler.
+typedef std::function<u8(u16 addr)> IORead;
+typedef std::function<void(u16 addr, u8 val)> IOWrite;
 
 class Bus {
 private:
 	std::vector<u8> memory;
-	std::vector<u8> file;
+	Cartridge cartridge;
 	CPU* cpu;
 	PPU* ppu;
 	Display* display;
+	const u8* readPages[0x100];
+	u8* writePages[0x100];
+	const u8* mappedRam = nullptr; // cartridge RAM bank at 0xA000 when last mapped
+	IORead ioReads[0x80];
+	IOWrite ioWrites[0x80];
+
+	// OAM DMA copies at once, then blocks the CPU outside 0xFF00-0xFFFF until
+	// dmaEnd (M-cycles). All pages are unmapped meanwhile, so the check costs
+	// nothing in read() and write().
+	bool dmaActive = false;
+	u64 dmaEnd = 0;
+	void startOamDma(u8 page);
+	bool endOamDma();
+
+	// One bit per 16-byte line set by every store to memory: a VRAM tile, half
+	// a tile map row, four OAM entries. Moved into each subscriber's own copy
+	// when it looks at a range, so a consumer clearing what it has seen never
+	// hides a write from another.
+	u64 dirtyLines[0x40] = {};
+	std::vector<std::array<u64, 0x40>> dirtyViews;
+	void markDirty(u16 addr) { dirtyLines[addr >> 10] |= 1ull << (addr >> 4 & 0x3F); }
+	void collectDirty(u16 start, u16 length);
+
+	void loadRom(std::shared_ptr<const RomImage> rom, const std::string& savePath = "");
+	void mapPages();
+	void mapCartridge();
+	void registerPorts();
+
+protected:
+	// Bus without memory for tests: every page is unmapped, so all accesses go
+	// to readSlow and writeSlow, which a test bus overrides
+	Bus(CPU* cpu);
+	virtual u8 readSlow(u16 addr);
+	virtual void writeSlow(u16 addr, u8 val);
 
 public:
 	Bus(CPU* cpu, PPU* ppu, Display* display);
-	u8 read(u16 addr);
+	Bus(CPU* cpu, PPU* ppu, Display* display, const std::string& romPath);
+	Bus(CPU* cpu, PPU* ppu, Display* display, const std::vector<u8>& rom);
+	virtual ~Bus() {}
+
+	// Inline so that memory accesses in the CPU loops compile to a page table
+	// load, only unmapped pages make a call
+	u8 read(u16 addr) {
+		const u8* page = readPages[addr >> 8];
+		if (page != nullptr) return page[addr & 0xFF];
+		return readSlow(addr);
+	}
+	void write(u16 addr, u8 val) {
+		if (cpu->isCode(addr)) cpu->invalidateCode(addr);
+		u8* page = writePages[addr >> 8];
+		if (page != nullptr) {
+			page[addr & 0xFF] = val;
+			markDirty(addr);
+			return;
+		}
+		writeSlow(addr, val);
+	}
+
+	// Page table behind read(), for code the dynarec emits
+	const u8* const* readPageTable() const { return readPages; }
+
+	// Written since `consumer` last cleared the range, e.g. VRAM 0x8000-0x9FFF,
+	// OAM 0xFE00-0xFE9F or WRAM 0xC000-0xDFFF. A new consumer starts with
+	// everything dirty.
+	int subscribeDirty();
+	bool isDirty(int consumer, u16 start, u16 length);
+	void clearDirty(int consumer, u16 start, u16 length);
+	bool isTileDirty(int consumer, u16 tile) { return isDirty(consumer, 0x8000 + tile * 16, 16); }
+	bool isTileMapRowDirty(int consumer, u8 map, u8 row) { return isDirty(consumer, (map ? 0x9C00 : 0x9800) + row * 32, 32); }
+	const u8* fetchWindow(u16 addr, u16& start, u16& size);
+	bool isDmaActive() { return dmaActive; }
 	std::span<u8> readRange(u16 addr, int length);
-	void write(u16 addr, u8 val);
+	void registerIO(u16 addr, IORead read, IOWrite write);
+	u16 getRomBank(u16 addr) { return cartridge.getRomBank(addr); }
+	void flushSave() { cartridge.flushSave(); }
 
-	void renderScanline(u8 row, std::vector<u8>* colours);
+	void renderScanline(u8 row, std::span<const u8> colours);
 };
\ No newline at end of file
@@ -3,7 +3,6 @@
 #include <fstream>
 #include <sstream>
 #include <functional>
-#include <set>
 #include <iterator>
 
 #include "CPU.h"
@@ -18,8 +17,6 @@ s8 toSigned(u8 b) { return b < 128 ? b : b - 256; }
 u8 hi(u8 val) { return val >> 4; }
 u8 lo(u8 val) { return val & 0xF; }
 
-set<int, greater<int> > s1;
-
 bool checkHalfCarry(u8 a, u8 b) {
 	return (((a & 0xf) + (b & 0xf)) & 0x10) == 0x10;
 }
@@ -28,17 +25,12 @@ bool checkCarry(u8 a, u8 b) {
 	return ((a ^ b ^ res) & 0x100) != 0;
 }
 
-CPU::CPU() {
+CPU::CPU(CPUEngine engine) : engine{ engine } {
 	//myfile.open("out.txt");
 
-	u8* A = &(AF.high);
-	u8* F = &(AF.low);
-	u8* B = &(BC.high);
-	u8* C = &(BC.low);
-	u8* D = &(DE.high);
-	u8* E = &(DE.low);
-	u8* H = &(HL.high);
-	u8* L = &(HL.low);
+	// The switch engine decodes opcodes itself, so skip building the closures
+	if (engine != CPUEngine::Table) return;
+
 	auto ZERO = COND(FLAGS::Z);
 	auto NZ = COND(FLAGS::Z, 0);
 	auto CARRY = COND(FLAGS::C);
@@ -47,106 +39,117 @@ CPU::CPU() {
 
 	lookup = {
 	{
-		{{"NOP", NOP(), 1},				{"LD BC, d16", LD(&BC), 3},		{"LD (BC), A", LD(&BC, A), 2},		{"INC BC", INC(&BC), 2},		{"INC B", INC(B), 1},			{"DEC B", DEC(B), 1},			{"LD B, d8", LD(B), 2},				{"RLCA", RLCA(), 1},			{"LD (a16), SP", STSP(&SP), 5},		{"ADD HL, BC", ADD(&HL, &BC), 2},	{"LD A, (BC)", LD(A, &BC), 2},		{"DEC BC", DEC(&BC), 2},		{"INC C", INC(C), 1},				{"DEC C", DEC(C), 1},			{"LD C, d8", LD(C), 2},				{"RRCA", RRCA(), 1}},
-		{{"STOP", STOP(), 1},			{"LD DE, d16",  LD(&DE), 3},	{"LD (DE), A", LD(&DE, A), 2},		{"INC DE", INC(&DE), 2},		{"INC D", INC(D), 1},			{"DEC D", DEC(D), 1},			{"LD D, d8", LD(D), 2},				{"RLA", RLA(), 1},				{"JR s8", JR(TRUE), 2},				{"ADD HL, DE", ADD(&HL, &DE), 2},	{"LD A, (DE)", LD(A, &DE), 2},		{"DEC DE", DEC(&DE), 2},		{"INC E", INC(E), 1},				{"DEC E", DEC(E), 1},			{"LD E, d8", LD(E), 2},				{"RRA", RRA(), 1}},
-		{{"JR NZ, s8", JR(NZ), 2},		{"LD HL, d16", LD(&HL), 3},		{"LDI (HL+), A", LDI(&HL, A), 2},	{"INC HL", INC(&HL), 2},		{"INC H", INC(H), 1},			{"DEC H", DEC(H), 1},			{"LD H, d8", LD(H), 2},				{"DAA", DAA(), 1},				{"JR Z, s8", JR(ZERO), 2},			{"ADD HL, HL", ADD(&HL, &HL), 2},	{"LD A, (HL+)", LDI(A, &HL), 2},	{"DEC HL", DEC(&HL), 2},		{"INC L", INC(L), 1},				{"DEC L", DEC(L), 1},			{"LD L, d8", LD(L), 2},				{"CPL", CPL(A), 1}},
-		{{"JR NC, s8", JR(NC), 2},		{"LD SP, d16", LD(&SP), 3},		{"LDD (HL-), A", LDD(&HL, A), 2},	{"INC SP", INC(&SP), 2},		{"INC (HL)", INC(), 3},			{"DEC (HL)", DEC(), 3},			{"LD (HL), d8", ST(&HL), 3},		{"SCF", SCF(), 1},				{"JR C, s8", JR(CARRY), 2},			{"ADD HL, SP", ADD(&HL, &SP), 2},	{"LD A, (HL-)", LDD(A, &HL), 2},	{"DEC SP", DEC(&SP), 2},		{"INC A", INC(A), 1},				{"DEC A", DEC(A), 1},			{"LD A, d8", LD(A), 2},				{"CCF", CCF(), 1}},
-		{{"LD B, B", LD(B, B), 1},		{"LD B, C", LD(B, C), 1},		{"LD B, D", LD(B, D), 1},			{"LD B, E", LD(B, E), 1},		{"LD B, H", LD(B, H), 1},		{"LD B, L", LD(B, L), 1},		{"LD B, (HL)", LD(B, &HL), 2},		{"LD B, A", LD(B, A), 1},		{"LD C, B", LD(C, B), 1},			{"LD C, C", LD(C, C), 1},			{"LD C, D", LD(C, D), 1},			{"LD C, E",LD(C, E), 1},		{"LD C, H", LD(C, H), 1},			{"LD C, L", LD(C, L), 1},		{"LD C, (HL)", LD(C, &HL), 2},		{"LD C, A", LD(C, A), 1}},
-		{{"LD D, B", LD(D, B), 1},		{"LD D, C", LD(D, C), 1},		{"LD D, D", LD(D, D), 1},			{"LD D, E", LD(D, E), 1},		{"LD D, H", LD(D, H), 1},		{"LD D, L", LD(D, L), 1},		{"LD D, (HL)", LD(D, &HL), 2},		{"LD D, A", LD(D, A), 1},		{"LD E, B", LD(E, B), 1},			{"LD E, C", LD(E, C), 1},			{"LD E, D", LD(E, D), 1},			{"LD E, E", LD(E, E), 1},		{"LD E, H", LD(E, H), 1},			{"LD E, L", LD(E, L), 1},		{"LD E, (HL)", LD(E, &HL), 2},		{"LD E, A", LD(E, A), 1}},
-		{{"LD H, B", LD(H, B), 1},		{"LD H, C", LD(H, C), 1},		{"LD H, D", LD(H, D), 1},			{"LD H, E", LD(H, E), 1},		{"LD H, H", LD(H, H), 1},		{"LD H, L", LD(H, L), 1},		{"LD H, (HL)", LD(H, &HL), 2},		{"LD H, A", LD(H, A), 1},		{"LD L, B", LD(L, B), 1},			{"LD L, C", LD(L, C), 1},			{"LD L, D", LD(L, D), 1},			{"LD L, E", LD(L, E), 1},		{"LD L, H", LD(L, H), 1},			{"LD L, L", LD(L, L), 1},		{"LD L, (HL)", LD(L, &HL), 2},		{"LD L, A", LD(L, A), 1}},
-		{{"LD (HL), B", LD(&HL, B), 1},	{"LD (HL), C", LD(&HL, C), 1},	{"LD (HL), D", LD(&HL, D), 1},		{"LD (HL), E", LD(&HL, E), 1},	{"LD (HL), H", LD(&HL, H), 1},	{"LD (HL), L", LD(&HL, L), 1},	{"HALT", HALT(), 1},				{"LD (HL), A", LD(&HL, A), 1},	{"LD A, B", LD(A, B), 1},			{"LD A, C", LD(A, C), 1},			{"LD A, D", LD(A, D), 1},			{"LD A, E", LD(A, E), 1},		{"LD A, H", LD(A, H), 1},			{"LD A, L", LD(A, L), 1},		{"LD A, (HL)", LD(A, &HL), 2},		{"LD A, A", LD(A, A), 1}},
-		{{"ADD A, B", ADD(B), 1},		{"ADD A, C", ADD(C), 1},		{"ADD A, D", ADD(D), 1},			{"ADD A, E", ADD(E), 1},		{"ADD A, H", ADD(H), 1},		{"ADD A, L", ADD(L), 1},		{"ADD A, (HL)", ADD(A, &HL), 2},	{"ADD A, A", ADD(A), 1},		{"ADC A, B", OP(B, ADC()), 2},		{"ADC A, C", OP(C, ADC()), 2},		{"ADC A, D", OP(D, ADC()), 2},		{"ADC A, E", OP(E, ADC()), 2},	{"ADC A, H", OP(H, ADC()), 2},		{"ADC A, L", OP(L, ADC()), 2},	{"ADC A, (HL)", OP(&HL, ADC()), 2},	{"ADC A, A", OP(A, ADC()), 2}},
-		{{"SUB B", OP(B, SUB()), 1},	{"SUB C", OP(C, SUB()), 1},		{"SUB D", OP(D, SUB()), 1},			{"SUB E", OP(E, SUB()), 1},		{"SUB H", OP(H, SUB()), 1},		{"SUB L", OP(L, SUB()), 1},		{"SUB (HL)", OP(&HL, SUB()), 2},	{"SUB A", OP(A, SUB()), 1},		{"SBC A, B", OP(B, SBC()), 2},		{"SBC A, C", OP(C, SBC()), 2},		{"SBC A, D", OP(D, SBC()), 2},		{"SBC A, E", OP(E, SBC()), 2},	{"SBC A, H", OP(H, SBC()), 2},		{"SBC A, L", OP(L, SBC()), 2},	{"SBC A, (HL)", OP(&HL, SBC()), 2},	{"SBC A, A", OP(A, SBC()), 1}},
-		{{"AND B", OP(B, AND()), 1},	{"AND C", OP(C, AND()), 1},		{"AND D", OP(D, AND()), 1},			{"AND E", OP(E, AND()), 1},		{"AND H", OP(H, AND()), 1},		{"AND L", OP(L, AND()), 1},		{"AND (HL)", OP(&HL, AND()), 2},	{"AND A", OP(A, AND()), 1},		{"XOR B", OP(B, XOR()), 1},			{"XOR C", OP(C, XOR()), 1},			{"XOR D", OP(D, XOR()), 1},			{"XOR E", OP(E, XOR()), 1},		{"XOR H", OP(H, XOR()), 1},			{"XOR L", OP(L, XOR()), 1},		{"XOR (HL)", OP(&HL, XOR()), 2},	{"XOR A", OP(A, XOR()), 1}},
-		{{"OR B", OP(B, OR()), 1},		{"OR C", OP(C, OR()), 1},		{"OR D", OP(D, OR()), 1},			{"OR E", OP(E, OR()), 1},		{"OR H", OP(H, OR()), 1},		{"OR L", OP(L, OR()), 1},		{"OR (HL)", OP(&HL, OR()), 2},		{"OR A", OP(A, OR()), 1},		{"CP B", OP(B, CP()), 1},			{"CP C", OP(C, CP()), 1},			{"CP D", OP(D, CP()), 1},			{"CP E", OP(E, CP()), 1},		{"CP H", OP(H, CP()), 1},			{"CP L", OP(L, CP()), 1},		{"CP (HL)", OP(&HL, CP()), 2},		{"CP A", OP(A, CP()), 1}},
-		{{"RET NZ", RET(NZ), 2},		{"POP BC", POP(&BC), 3},		{"JP NZ, a16", JP(NZ), 3},			{"JP a16", JP(TRUE), 4},		{"CALL NZ, a16", CALL(NZ), 3},	{"PUSH BC", PUSH(&BC), 4},		{"ADD A, d8", ADD(), 2},			{"RST 0", RST(0), 4},			{"RET Z", RET(ZERO), 2},			{"RET", RET(), 4},					{"JP Z, a16", JP(ZERO), 3},			{"???", XXX(), 0},				{"CALL Z, a16", CALL(ZERO), 3},		{"CALL a16", CALL(TRUE), 3},	{"ADC A, d8", OP(ADC()), 2},		{"RST 1", RST(1), 4}},
-		{{"RET NC", RET(NC), 2},		{"POP DE", POP(&DE), 3},		{"JP NC, a16", JP(NC), 3},			{"???", XXX(), 0},				{"CALL NC, a16", CALL(NC), 3},	{"PUSH DE", PUSH(&DE), 4},		{"SUB d8", OP(SUB()), 2},			{"RST 2", RST(2), 4},			{"RET C", RET(CARRY), 2},			{"RETI", RETI(), 4},				{"JP C, a16", JP(CARRY), 3},		{"???", XXX(), 0},				{"CALL C, a16", CALL(CARRY), 3},	{"???", XXX(), 0},				{"SBC A, d8", OP(SBC()), 2},		{"RST 3", RST(3), 4}},
-		{{"LDH (a8), A", STH(A), 3},	{"POP HL", POP(&HL), 3},		{"LD (C), A", STH(C, A), 2},		{"???", XXX(), 0},				{"???", XXX(), 0},				{"PUSH HL", PUSH(&HL), 4},		{"AND d8", OP(AND()), 2},			{"RST 4", RST(4), 4},			{"ADD SP, s8", ADD(&SP), 4},		{"JP HL", JP(&HL), 1},				{"LD (a16), A", STA(A), 4},			{"???", XXX(), 0},				{"???", XXX(), 0},					{"???", XXX(), 0},				{"XOR d8", OP(XOR()), 2},			{"RST 5", RST(5), 4}},
-		{{"LDH A, (a8)", LDH(A), 3},	{"POP AF", POP(), 3},			{"LD A, (C)", LDH(A, C), 2},		{"DI", DI(), 1},				{"???", XXX(), 0},				{"PUSH AF", PUSH(&AF), 4},		{"OR d8", OP(OR()), 2},				{"RST 6", RST(6), 4},			{"LD HL, SP+s8", LDHL(&HL, &SP),3},	{"LD SP, HL", LD(&SP, &HL), 2},		{"LD A, (a16)", LDA(A), 4},			{"EI", EI(), 1},				{"???", XXX(), 0},					{"???", XXX(), 0},				{"CP d8",OP(CP()), 2},				{"RST 7", RST(7), 4}}
+		{{"NOP", NOP(), 1},				{"LD BC, d16", LD(&BC), 3},		{"LD (BC), A", ST<RegA>(&BC), 2},		{"INC BC", INC(&BC), 2},		{"INC B", INC<RegB>(), 1},			{"DEC B", DEC<RegB>(), 1},			{"LD B, d8", LD<RegB>(), 2},				{"RLCA", RLCA(), 1},			{"LD (a16), SP", STSP(&SP), 5},		{"ADD HL, BC", ADD(&HL, &BC), 2},	{"LD A, (BC)", LD<RegA>(&BC), 2},		{"DEC BC", DEC(&BC), 2},		{"INC C", INC<RegC>(), 1},				{"DEC C", DEC<RegC>(), 1},			{"LD C, d8", LD<RegC>(), 2},				{"RRCA", RRCA(), 1}},
+		{{"STOP", STOP(), 1},			{"LD DE, d16",  LD(&DE), 3},	{"LD (DE), A", ST<RegA>(&DE), 2},		{"INC DE", INC(&DE), 2},		{"INC D", INC<RegD>(), 1},			{"DEC D", DEC<RegD>(), 1},			{"LD D, d8", LD<RegD>(), 2},				{"RLA", RLA(), 1},				{"JR s8", JR(TRUE), 2},				{"ADD HL, DE", ADD(&HL, &DE), 2},	{"LD A, (DE)", LD<RegA>(&DE), 2},		{"DEC DE", DEC(&DE), 2},		{"INC E", INC<RegE>(), 1},				{"DEC E", DEC<RegE>(), 1},			{"LD E, d8", LD<RegE>(), 2},				{"RRA", RRA(), 1}},
+		{{"JR NZ, s8", JR(NZ), 2},		{"LD HL, d16", LD(&HL), 3},		{"LDI (HL+), A", STI<RegA>(&HL), 2},	{"INC HL", INC(&HL), 2},		{"INC H", INC<RegH>(), 1},			{"DEC H", DEC<RegH>(), 1},			{"LD H, d8", LD<RegH>(), 2},				{"DAA", DAA(), 1},				{"JR Z, s8", JR(ZERO), 2},			{"ADD HL, HL", ADD(&HL, &HL), 2},	{"LD A, (HL+)", LDI<RegA>(&HL), 2},	{"DEC HL", DEC(&HL), 2},		{"INC L", INC<RegL>(), 1},				{"DEC L", DEC<RegL>(), 1},			{"LD L, d8", LD<RegL>(), 2},				{"CPL", CPL<RegA>(), 1}},
+		{{"JR NC, s8", JR(NC), 2},		{"LD SP, d16", LD(&SP), 3},		{"LDD (HL-), A", STD<RegA>(&HL), 2},	{"INC SP", INC(&SP), 2},		{"INC (HL)", INC(), 3},			{"DEC (HL)", DEC(), 3},			{"LD (HL), d8", ST(&HL), 3},		{"SCF", SCF(), 1},				{"JR C, s8", JR(CARRY), 2},			{"ADD HL, SP", ADD(&HL, &SP), 2},	{"LD A, (HL-)", LDD<RegA>(&HL), 2},	{"DEC SP", DEC(&SP), 2},		{"INC A", INC<RegA>(), 1},				{"DEC A", DEC<RegA>(), 1},			{"LD A, d8", LD<RegA>(), 2},				{"CCF", CCF(), 1}},
+		{{"LD B, B", LD<RegB, RegB>(), 1},		{"LD B, C", LD<RegB, RegC>(), 1},		{"LD B, D", LD<RegB, RegD>(), 1},			{"LD B, E", LD<RegB, RegE>(), 1},		{"LD B, H", LD<RegB, RegH>(), 1},		{"LD B, L", LD<RegB, RegL>(), 1},		{"LD B, (HL)", LD<RegB>(&HL), 2},		{"LD B, A", LD<RegB, RegA>(), 1},		{"LD C, B", LD<RegC, RegB>(), 1},			{"LD C, C", LD<RegC, RegC>(), 1},			{"LD C, D", LD<RegC, RegD>(), 1},			{"LD C, E",LD<RegC, RegE>(), 1},		{"LD C, H", LD<RegC, RegH>(), 1},			{"LD C, L", LD<RegC, RegL>(), 1},		{"LD C, (HL)", LD<RegC>(&HL), 2},		{"LD C, A", LD<RegC, RegA>(), 1}},
+		{{"LD D, B", LD<RegD, RegB>(), 1},		{"LD D, C", LD<RegD, RegC>(), 1},		{"LD D, D", LD<RegD, RegD>(), 1},			{"LD D, E", LD<RegD, RegE>(), 1},		{"LD D, H", LD<RegD, RegH>(), 1},		{"LD D, L", LD<RegD, RegL>(), 1},		{"LD D, (HL)", LD<RegD>(&HL), 2},		{"LD D, A", LD<RegD, RegA>(), 1},		{"LD E, B", LD<RegE, RegB>(), 1},			{"LD E, C", LD<RegE, RegC>(), 1},			{"LD E, D", LD<RegE, RegD>(), 1},			{"LD E, E", LD<RegE, RegE>(), 1},		{"LD E, H", LD<RegE, RegH>(), 1},			{"LD E, L", LD<RegE, RegL>(), 1},		{"LD E, (HL)", LD<RegE>(&HL), 2},		{"LD E, A", LD<RegE, RegA>(), 1}},
+		{{"LD H, B", LD<RegH, RegB>(), 1},		{"LD H, C", LD<RegH, RegC>(), 1},		{"LD H, D", LD<RegH, RegD>(), 1},			{"LD H, E", LD<RegH, RegE>(), 1},		{"LD H, H", LD<RegH, RegH>(), 1},		{"LD H, L", LD<RegH, RegL>(), 1},		{"LD H, (HL)", LD<RegH>(&HL), 2},		{"LD H, A", LD<RegH, RegA>(), 1},		{"LD L, B", LD<RegL, RegB>(), 1},			{"LD L, C", LD<RegL, RegC>(), 1},			{"LD L, D", LD<RegL, RegD>(), 1},			{"LD L, E", LD<RegL, RegE>(), 1},		{"LD L, H", LD<RegL, RegH>(), 1},			{"LD L, L", LD<RegL, RegL>(), 1},		{"LD L, (HL)", LD<RegL>(&HL), 2},		{"LD L, A", LD<RegL, RegA>(), 1}},
+		{{"LD (HL), B", ST<RegB>(&HL), 1},	{"LD (HL), C", ST<RegC>(&HL), 1},	{"LD (HL), D", ST<RegD>(&HL), 1},		{"LD (HL), E", ST<RegE>(&HL), 1},	{"LD (HL), H", ST<RegH>(&HL), 1},	{"LD (HL), L", ST<RegL>(&HL), 1},	{"HALT", HALT(), 1},				{"LD (HL), A", ST<RegA>(&HL), 1},	{"LD A, B", LD<RegA, RegB>(), 1},			{"LD A, C", LD<RegA, RegC>(), 1},			{"LD A, D", LD<RegA, RegD>(), 1},			{"LD A, E", LD<RegA, RegE>(), 1},		{"LD A, H", LD<RegA, RegH>(), 1},			{"LD A, L", LD<RegA, RegL>(), 1},		{"LD A, (HL)", LD<RegA>(&HL), 2},		{"LD A, A", LD<RegA, RegA>(), 1}},
+		{{"ADD A, B", ADD<RegB>(), 1},		{"ADD A, C", ADD<RegC>(), 1},		{"ADD A, D", ADD<RegD>(), 1},			{"ADD A, E", ADD<RegE>(), 1},		{"ADD A, H", ADD<RegH>(), 1},		{"ADD A, L", ADD<RegL>(), 1},		{"ADD A, (HL)", ADD<RegA>(&HL), 2},	{"ADD A, A", ADD<RegA>(), 1},		{"ADC A, B", OP<RegB, &CPU::aluADC>(), 2},		{"ADC A, C", OP<RegC, &CPU::aluADC>(), 2},		{"ADC A, D", OP<RegD, &CPU::aluADC>(), 2},		{"ADC A, E", OP<RegE, &CPU::aluADC>(), 2},	{"ADC A, H", OP<RegH, &CPU::aluADC>(), 2},		{"ADC A, L", OP<RegL, &CPU::aluADC>(), 2},	{"ADC A, (HL)", OP<&CPU::aluADC>(&HL), 2},	{"ADC A, A", OP<RegA, &CPU::aluADC>(), 2}},
+		{{"SUB B", OP<RegB, &CPU::aluSUB>(), 1},	{"SUB C", OP<RegC, &CPU::aluSUB>(), 1},		{"SUB D", OP<RegD, &CPU::aluSUB>(), 1},			{"SUB E", OP<RegE, &CPU::aluSUB>(), 1},		{"SUB H", OP<RegH, &CPU::aluSUB>(), 1},		{"SUB L", OP<RegL, &CPU::aluSUB>(), 1},		{"SUB (HL)", OP<&CPU::aluSUB>(&HL), 2},	{"SUB A", OP<RegA, &CPU::aluSUB>(), 1},		{"SBC A, B", OP<RegB, &CPU::aluSBC>(), 2},		{"SBC A, C", OP<RegC, &CPU::aluSBC>(), 2},		{"SBC A, D", OP<RegD, &CPU::aluSBC>(), 2},		{"SBC A, E", OP<RegE, &CPU::aluSBC>(), 2},	{"SBC A, H", OP<RegH, &CPU::aluSBC>(), 2},		{"SBC A, L", OP<RegL, &CPU::aluSBC>(), 2},	{"SBC A, (HL)", OP<&CPU::aluSBC>(&HL), 2},	{"SBC A, A", OP<RegA, &CPU::aluSBC>(), 1}},
+		{{"AND B", OP<RegB, &CPU::aluAND>(), 1},	{"AND C", OP<RegC, &CPU::aluAND>(), 1},		{"AND D", OP<RegD, &CPU::aluAND>(), 1},			{"AND E", OP<RegE, &CPU::aluAND>(), 1},		{"AND H", OP<RegH, &CPU::aluAND>(), 1},		{"AND L", OP<RegL, &CPU::aluAND>(), 1},		{"AND (HL)", OP<&CPU::aluAND>(&HL), 2},	{"AND A", OP<RegA, &CPU::aluAND>(), 1},		{"XOR B", OP<RegB, &CPU::aluXOR>(), 1},			{"XOR C", OP<RegC, &CPU::aluXOR>(), 1},			{"XOR D", OP<RegD, &CPU::aluXOR>(), 1},			{"XOR E", OP<RegE, &CPU::aluXOR>(), 1},		{"XOR H", OP<RegH, &CPU::aluXOR>(), 1},			{"XOR L", OP<RegL, &CPU::aluXOR>(), 1},		{"XOR (HL)", OP<&CPU::aluXOR>(&HL), 2},	{"XOR A", OP<RegA, &CPU::aluXOR>(), 1}},
+		{{"OR B", OP<RegB, &CPU::aluOR>(), 1},		{"OR C", OP<RegC, &CPU::aluOR>(), 1},		{"OR D", OP<RegD, &CPU::aluOR>(), 1},			{"OR E", OP<RegE, &CPU::aluOR>(), 1},		{"OR H", OP<RegH, &CPU::aluOR>(), 1},		{"OR L", OP<RegL, &CPU::aluOR>(), 1},		{"OR (HL)", OP<&CPU::aluOR>(&HL), 2},		{"OR A", OP<RegA, &CPU::aluOR>(), 1},		{"CP B", OP<RegB, &CPU::aluCP>(), 1},			{"CP C", OP<RegC, &CPU::aluCP>(), 1},			{"CP D", OP<RegD, &CPU::aluCP>(), 1},			{"CP E", OP<RegE, &CPU::aluCP>(), 1},		{"CP H", OP<RegH, &CPU::aluCP>(), 1},			{"CP L", OP<RegL, &CPU::aluCP>(), 1},		{"CP (HL)", OP<&CPU::aluCP>(&HL), 2},		{"CP A", OP<RegA, &CPU::aluCP>(), 1}},
+		{{"RET NZ", RET(NZ), 2},		{"POP BC", POP(&BC), 3},		{"JP NZ, a16", JP(NZ), 3},			{"JP a16", JP(TRUE), 4},		{"CALL NZ, a16", CALL(NZ), 3},	{"PUSH BC", PUSH(&BC), 4},		{"ADD A, d8", ADD(), 2},			{"RST 0", RST(0), 4},			{"RET Z", RET(ZERO), 2},			{"RET", RET(), 4},					{"JP Z, a16", JP(ZERO), 3},			{"???", XXX(), 0},				{"CALL Z, a16", CALL(ZERO), 3},		{"CALL a16", CALL(TRUE), 3},	{"ADC A, d8", OP<&CPU::aluADC>(), 2},		{"RST 1", RST(1), 4}},
+		{{"RET NC", RET(NC), 2},		{"POP DE", POP(&DE), 3},		{"JP NC, a16", JP(NC), 3},			{"???", XXX(), 0},				{"CALL NC, a16", CALL(NC), 3},	{"PUSH DE", PUSH(&DE), 4},		{"SUB d8", OP<&CPU::aluSUB>(), 2},			{"RST 2", RST(2), 4},			{"RET C", RET(CARRY), 2},			{"RETI", RETI(), 4},				{"JP C, a16", JP(CARRY), 3},		{"???", XXX(), 0},				{"CALL C, a16", CALL(CARRY), 3},	{"???", XXX(), 0},				{"SBC A, d8", OP<&CPU::aluSBC>(), 2},		{"RST 3", RST(3), 4}},
+		{{"LDH (a8), A", STH<RegA>(), 3},	{"POP HL", POP(&HL), 3},		{"LD (C), A", STH<RegC, RegA>(), 2},		{"???", XXX(), 0},				{"???", XXX(), 0},				{"PUSH HL", PUSH(&HL), 4},		{"AND d8", OP<&CPU::aluAND>(), 2},			{"RST 4", RST(4), 4},			{"ADD SP, s8", ADD(&SP), 4},		{"JP HL", JP(&HL), 1},				{"LD (a16), A", STA<RegA>(), 4},			{"???", XXX(), 0},				{"???", XXX(), 0},					{"???", XXX(), 0},				{"XOR d8", OP<&CPU::aluXOR>(), 2},			{"RST 5", RST(5), 4}},
+		{{"LDH A, (a8)", LDH<RegA>(), 3},	{"POP AF", POP(), 3},			{"LD A, (C)", LDH<RegA, RegC>(), 2},		{"DI", DI(), 1},				{"???", XXX(), 0},				{"PUSH AF", PUSH(&AF), 4},		{"OR d8", OP<&CPU::aluOR>(), 2},				{"RST 6", RST(6), 4},			{"LD HL, SP+s8", LDHL(&HL, &SP),3},	{"LD SP, HL", LD(&SP, &HL), 2},		{"LD A, (a16)", LDA<RegA>(), 4},			{"EI", EI(), 1},				{"???", XXX(), 0},					{"???", XXX(), 0},				{"CP d8",OP<&CPU::aluCP>(), 2},				{"RST 7", RST(7), 4}}
 	},
 	{
-		{{"RLC B", RLC(B), 2},			{"RLC C", RLC(C), 2},			{"RLC D", RLC(D), 2},				{"RLC E", RLC(E), 2},			{"RLC H", RLC(H), 2},			{"RLC L", RLC(L), 2},			{"RLC (HL)", RLC(&HL), 4},			{"RLC A", RLC(A), 2},			{"RRC B", RRC(B), 2},				{"RRC C", RRC(C), 2},				{"RRC D", RRC(D), 2},				{"RRC E", RRC(E), 2},			{"RRC H", RRC(H), 2},				{"RRC L", RRC(L), 2},			{"RRC (HL)", RRC(&HL), 4},			{"RRC A", RRC(A), 2}},
-		{{"RL B", RL(B), 2},			{"RL C", RL(C), 2},				{"RL D", RL(D), 2},					{"RL E", RL(E), 2},				{"RL H", RL(H), 2},				{"RL L", RL(L), 2},				{"RL (HL)", RL(&HL), 4},			{"RL A", RL(A), 2},				{"RR B", RR(B), 2},					{"RR C", RR(C), 2},					{"RR D", RR(D), 2},					{"RR E", RR(E), 2},				{"RR H", RR(H), 2},					{"RR L", RR(L), 2},				{"RR (HL)", RR(&HL), 4},			{"RR A", RR(A), 2}},
-		{{"SLA B", SLA(B), 2},			{"SLA C", SLA(C), 2},			{"SLA D", SLA(D), 2},				{"SLA E", SLA(E), 2},			{"SLA H", SLA(H), 2},			{"SLA L", SLA(L), 2},			{"SLA (HL)", SLA(&HL), 4},			{"SLA A", SLA(A), 2},			{"SRA B", SRA(B), 2},				{"SRA C", SRA(C), 2},				{"SRA D", SRA(D), 2},				{"SRA E", SRA(E), 2},			{"SRA H", SRA(H), 2},				{"SRA L", SRA(L), 2},			{"SRA (HL)", SRA(&HL), 4},			{"SRA A", SRA(A), 2}},
-		{{"SWAP B", SWAP(B), 2},		{"SWAP C", SWAP(C), 2},			{"SWAP D", SWAP(D), 2},				{"SWAP E", SWAP(E), 2},			{"SWAP H", SWAP(H), 2},			{"SWAP L", SWAP(L), 2},			{"SWAP (HL)", SWAP(&HL), 4},		{"SWAP A", SWAP(A), 2},			{"SRL B", SRL(B), 2},				{"SRL C", SRL(C), 2},				{"SRL D", SRL(D), 2},				{"SRL E", SRL(E), 2},			{"SRL H", SRL(H), 2},				{"SRL L", SRL(L), 2},			{"SRL (HL)", SRL(&HL), 4},			{"SRL A", SRL(A), 2}},
-		{{"BIT 0, B", BIT(0, B), 2},	{"BIT 0, C", BIT(0, C), 2},		{"BIT 0, D", BIT(0, D), 2},			{"BIT 0, E", BIT(0, E), 2},		{"BIT 0, H", BIT(0, H), 2},		{"BIT 0, L", BIT(0, L), 2},		{"BIT 0, (HL)", BIT(0, &HL), 4},	{"BIT 0, A", BIT(0, A), 2},		{"BIT 1, B", BIT(1, B), 2},			{"BIT 1, C", BIT(1, C), 2},			{"BIT 1, D", BIT(1, D), 2},			{"BIT 1, E", BIT(1, E), 2},		{"BIT 1, H", BIT(1, H), 2},			{"BIT 1, L", BIT(1, L), 2},		{"BIT 1, (HL)", BIT(1, &HL), 4},	{"BIT 1, A", BIT(1, A), 2}},
-		{{"BIT 2, B", BIT(2, B), 2},	{"BIT 2, C", BIT(2, C), 2},		{"BIT 2, D", BIT(2, D), 2},			{"BIT 2, E", BIT(2, E), 2},		{"BIT 2, H", BIT(2, H), 2},		{"BIT 2, L", BIT(2, L), 2},		{"BIT 2, (HL)", BIT(2, &HL), 4},	{"BIT 2, A", BIT(2, A), 2},		{"BIT 3, B", BIT(3, B), 2},			{"BIT 3, C", BIT(3, C), 2},			{"BIT 3, D", BIT(3, D), 2},			{"BIT 3, E", BIT(3, E), 2},		{"BIT 3, H", BIT(3, H), 2},			{"BIT 3, L", BIT(3, L), 2},		{"BIT 3, (HL)", BIT(3, &HL), 4},	{"BIT 3, A", BIT(3, A), 2}},
-		{{"BIT 4, B", BIT(4, B), 2},	{"BIT 4, C", BIT(4, C), 2},		{"BIT 4, D", BIT(4, D), 2},			{"BIT 4, E", BIT(4, E), 2},		{"BIT 4, H", BIT(4, H), 2},		{"BIT 4, L", BIT(4, L), 2},		{"BIT 4, (HL)", BIT(4, &HL), 4},	{"BIT 4, A", BIT(4, A), 2},		{"BIT 5, B", BIT(5, B), 2},			{"BIT 5, C", BIT(5, C), 2},			{"BIT 5, D", BIT(5, D), 2},			{"BIT 5, E", BIT(5, E), 2},		{"BIT 5, H", BIT(5, H), 2},			{"BIT 5, L", BIT(5, L), 2},		{"BIT 5, (HL)", BIT(5, &HL), 4},	{"BIT 5, A", BIT(5, A), 2}},
-		{{"BIT 6, B", BIT(6, B), 2},	{"BIT 6, C", BIT(6, C), 2},		{"BIT 6, D", BIT(6, D), 2},			{"BIT 6, E", BIT(6, E), 2},		{"BIT 6, H", BIT(6, H), 2},		{"BIT 6, L", BIT(6, L), 2},		{"BIT 6, (HL)", BIT(6, &HL), 4},	{"BIT 6, A", BIT(6, A), 2},		{"BIT 7, B", BIT(7, B), 2},			{"BIT 7, C", BIT(7, C), 2},			{"BIT 7, D", BIT(7, D), 2},			{"BIT 7, E", BIT(7, E), 2},		{"BIT 7, H", BIT(7, H), 2},			{"BIT 7, L", BIT(7, L), 2},		{"BIT 7, (HL)", BIT(7, &HL), 4},	{"BIT 7, A", BIT(7, A), 2}},
-		{{"RES 0, B", RES(0, B), 2},	{"RES 0, C", RES(0, C), 2},		{"RES 0, D", RES(0, D), 2},			{"RES 0, E", RES(0, E), 2},		{"RES 0, H", RES(0, H), 2},		{"RES 0, L", RES(0, L), 2},		{"RES 0, (HL)", RES(0, &HL), 4},	{"RES 0, A", RES(0, A), 2},		{"RES 1, B", RES(1, B), 2},			{"RES 1, C", RES(1, C), 2},			{"RES 1, D", RES(1, D), 2},			{"RES 1, E", RES(1, E), 2},		{"RES 1, H", RES(1, H), 2},			{"RES 1, L", RES(1, L), 2},		{"RES 1, (HL)", RES(1, &HL), 4},	{"RES 1, A", RES(1, A), 2}},
-		{{"RES 2, B", RES(2, B), 2},	{"RES 2, C", RES(2, C), 2},		{"RES 2, D", RES(2, D), 2},			{"RES 2, E", RES(2, E), 2},		{"RES 2, H", RES(2, H), 2},		{"RES 2, L", RES(2, L), 2},		{"RES 2, (HL)", RES(2, &HL), 4},	{"RES 2, A", RES(2, A), 2},		{"RES 3, B", RES(3, B), 2},			{"RES 3, C", RES(3, C), 2},			{"RES 3, D", RES(3, D), 2},			{"RES 3, E", RES(3, E), 2},		{"RES 3, H", RES(3, H), 2},			{"RES 3, L", RES(3, L), 2},		{"RES 3, (HL)", RES(3, &HL), 4},	{"RES 3, A", RES(3, A), 2}},
-		{{"RES 4, B", RES(4, B), 2},	{"RES 4, C", RES(4, C), 2},		{"RES 4, D", RES(4, D), 2},			{"RES 4, E", RES(4, E), 2},		{"RES 4, H", RES(4, H), 2},		{"RES 4, L", RES(4, L), 2},		{"RES 4, (HL)", RES(4, &HL), 4},	{"RES 4, A", RES(4, A), 2},		{"RES 5, B", RES(5, B), 2},			{"RES 5, C", RES(5, C), 2},			{"RES 5, D", RES(5, D), 2},			{"RES 5, E", RES(5, E), 2},		{"RES 5, H", RES(5, H), 2},			{"RES 5, L", RES(5, L), 2},		{"RES 5, (HL)", RES(5, &HL), 4},	{"RES 5, A", RES(5, A), 2}},
-		{{"RES 6, B", RES(6, B), 2},	{"RES 6, C", RES(6, C), 2},		{"RES 6, D", RES(6, D), 2},			{"RES 6, E", RES(6, E), 2},		{"RES 6, H", RES(6, H), 2},		{"RES 6, L", RES(6, L), 2},		{"RES 6, (HL)", RES(6, &HL), 4},	{"RES 6, A", RES(6, A), 2},		{"RES 7, B", RES(7, B), 2},			{"RES 7, C", RES(7, C), 2},			{"RES 7, D", RES(7, D), 2},			{"RES 7, E", RES(7, E), 2},		{"RES 7, H", RES(7, H), 2},			{"RES 7, L", RES(7, L), 2},		{"RES 7, (HL)", RES(7, &HL), 4},	{"RES 7, A", RES(7, A), 2}},
-		{{"SET 0, B", SET(0, B), 2},	{"SET 0, C", SET(0, C), 2},		{"SET 0, D", SET(0, D), 2},			{"SET 0, E", SET(0, E), 2},		{"SET 0, H", SET(0, H), 2},		{"SET 0, L", SET(0, L), 2},		{"SET 0, (HL)", SET(0, &HL), 4},	{"SET 0, A", SET(0, A), 2},		{"SET 1, B", SET(1, B), 2},			{"SET 1, C", SET(1, C), 2},			{"SET 1, D", SET(1, D), 2},			{"SET 1, E", SET(1, E), 2},		{"SET 1, H", SET(1, H), 2},			{"SET 1, L", SET(1, L), 2},		{"SET 1, (HL)", SET(1, &HL), 4},	{"SET 1, A", SET(1, A), 2}},
-		{{"SET 2, B", SET(2, B), 2},	{"SET 2, C", SET(2, C), 2},		{"SET 2, D", SET(2, D), 2},			{"SET 2, E", SET(2, E), 2},		{"SET 2, H", SET(2, H), 2},		{"SET 2, L", SET(2, L), 2},		{"SET 2, (HL)", SET(2, &HL), 4},	{"SET 2, A", SET(2, A), 2},		{"SET 3, B", SET(3, B), 2},			{"SET 3, C", SET(3, C), 2},			{"SET 3, D", SET(3, D), 2},			{"SET 3, E", SET(3, E), 2},		{"SET 3, H", SET(3, H), 2},			{"SET 3, L", SET(3, L), 2},		{"SET 3, (HL)", SET(3, &HL), 4},	{"SET 3, A", SET(3, A), 2}},
-		{{"SET 4, B", SET(4, B), 2},	{"SET 4, C", SET(4, C), 2},		{"SET 4, D", SET(4, D), 2},			{"SET 4, E", SET(4, E), 2},		{"SET 4, H", SET(4, H), 2},		{"SET 4, L", SET(4, L), 2},		{"SET 4, (HL)", SET(4, &HL), 4},	{"SET 4, A", SET(4, A), 2},		{"SET 5, B", SET(5, B), 2},			{"SET 5, C", SET(5, C), 2},			{"SET 5, D", SET(5, D), 2},			{"SET 5, E", SET(5, E), 2},		{"SET 5, H", SET(5, H), 2},			{"SET 5, L", SET(5, L), 2},		{"SET 5, (HL)", SET(5, &HL), 4},	{"SET 5, A", SET(5, A), 2}},
-		{{"SET 6, B", SET(6, B), 2},	{"SET 6, C", SET(6, C), 2},		{"SET 6, D", SET(6, D), 2},			{"SET 6, E", SET(6, E), 2},		{"SET 6, H", SET(6, H), 2},		{"SET 6, L", SET(6, L), 2},		{"SET 6, (HL)", SET(6, &HL), 4},	{"SET 6, A", SET(6, A), 2},		{"SET 7, B", SET(7, B), 2},			{"SET 7, C", SET(7, C), 2},			{"SET 7, D", SET(7, D), 2},			{"SET 7, E", SET(7, E), 2},		{"SET 7, H", SET(7, H), 2},			{"SET 7, L", SET(7, L), 2},		{"SET 7, (HL)", SET(7, &HL), 4},	{"SET 7, A", SET(7, A), 2}}
+		{{"RLC B", RLC<RegB>(), 2},			{"RLC C", RLC<RegC>(), 2},			{"RLC D", RLC<RegD>(), 2},				{"RLC E", RLC<RegE>(), 2},			{"RLC H", RLC<RegH>(), 2},			{"RLC L", RLC<RegL>(), 2},			{"RLC (HL)", RLC(&HL), 4},			{"RLC A", RLC<RegA>(), 2},			{"RRC B", RRC<RegB>(), 2},				{"RRC C", RRC<RegC>(), 2},				{"RRC D", RRC<RegD>(), 2},				{"RRC E", RRC<RegE>(), 2},			{"RRC H", RRC<RegH>(), 2},				{"RRC L", RRC<RegL>(), 2},			{"RRC (HL)", RRC(&HL), 4},			{"RRC A", RRC<RegA>(), 2}},
+		{{"RL B", RL<RegB>(), 2},			{"RL C", RL<RegC>(), 2},				{"RL D", RL<RegD>(), 2},					{"RL E", RL<RegE>(), 2},				{"RL H", RL<RegH>(), 2},				{"RL L", RL<RegL>(), 2},				{"RL (HL)", RL(&HL), 4},			{"RL A", RL<RegA>(), 2},				{"RR B", RR<RegB>(), 2},					{"RR C", RR<RegC>(), 2},					{"RR D", RR<RegD>(), 2},					{"RR E", RR<RegE>(), 2},				{"RR H", RR<RegH>(), 2},					{"RR L", RR<RegL>(), 2},				{"RR (HL)", RR(&HL), 4},			{"RR A", RR<RegA>(), 2}},
+		{{"SLA B", SLA<RegB>(), 2},			{"SLA C", SLA<RegC>(), 2},			{"SLA D", SLA<RegD>(), 2},				{"SLA E", SLA<RegE>(), 2},			{"SLA H", SLA<RegH>(), 2},			{"SLA L", SLA<RegL>(), 2},			{"SLA (HL)", SLA(&HL), 4},			{"SLA A", SLA<RegA>(), 2},			{"SRA B", SRA<RegB>(), 2},				{"SRA C", SRA<RegC>(), 2},				{"SRA D", SRA<RegD>(), 2},				{"SRA E", SRA<RegE>(), 2},			{"SRA H", SRA<RegH>(), 2},				{"SRA L", SRA<RegL>(), 2},			{"SRA (HL)", SRA(&HL), 4},			{"SRA A", SRA<RegA>(), 2}},
+		{{"SWAP B", SWAP<RegB>(), 2},		{"SWAP C", SWAP<RegC>(), 2},			{"SWAP D", SWAP<RegD>(), 2},				{"SWAP E", SWAP<RegE>(), 2},			{"SWAP H", SWAP<RegH>(), 2},			{"SWAP L", SWAP<RegL>(), 2},			{"SWAP (HL)", SWAP(&HL), 4},		{"SWAP A", SWAP<RegA>(), 2},			{"SRL B", SRL<RegB>(), 2},				{"SRL C", SRL<RegC>(), 2},				{"SRL D", SRL<RegD>(), 2},				{"SRL E", SRL<RegE>(), 2},			{"SRL H", SRL<RegH>(), 2},				{"SRL L", SRL<RegL>(), 2},			{"SRL (HL)", SRL(&HL), 4},			{"SRL A", SRL<RegA>(), 2}},
+		{{"BIT 0, B", BIT<RegB>(0), 2},	{"BIT 0, C", BIT<RegC>(0), 2},		{"BIT 0, D", BIT<RegD>(0), 2},			{"BIT 0, E", BIT<RegE>(0), 2},		{"BIT 0, H", BIT<RegH>(0), 2},		{"BIT 0, L", BIT<RegL>(0), 2},		{"BIT 0, (HL)", BIT(0, &HL), 4},	{"BIT 0, A", BIT<RegA>(0), 2},		{"BIT 1, B", BIT<RegB>(1), 2},			{"BIT 1, C", BIT<RegC>(1), 2},			{"BIT 1, D", BIT<RegD>(1), 2},			{"BIT 1, E", BIT<RegE>(1), 2},		{"BIT 1, H", BIT<RegH>(1), 2},			{"BIT 1, L", BIT<RegL>(1), 2},		{"BIT 1, (HL)", BIT(1, &HL), 4},	{"BIT 1, A", BIT<RegA>(1), 2}},
+		{{"BIT 2, B", BIT<RegB>(2), 2},	{"BIT 2, C", BIT<RegC>(2), 2},		{"BIT 2, D", BIT<RegD>(2), 2},			{"BIT 2, E", BIT<RegE>(2), 2},		{"BIT 2, H", BIT<RegH>(2), 2},		{"BIT 2, L", BIT<RegL>(2), 2},		{"BIT 2, (HL)", BIT(2, &HL), 4},	{"BIT 2, A", BIT<RegA>(2), 2},		{"BIT 3, B", BIT<RegB>(3), 2},			{"BIT 3, C", BIT<RegC>(3), 2},			{"BIT 3, D", BIT<RegD>(3), 2},			{"BIT 3, E", BIT<RegE>(3), 2},		{"BIT 3, H", BIT<RegH>(3), 2},			{"BIT 3, L", BIT<RegL>(3), 2},		{"BIT 3, (HL)", BIT(3, &HL), 4},	{"BIT 3, A", BIT<RegA>(3), 2}},
+		{{"BIT 4, B", BIT<RegB>(4), 2},	{"BIT 4, C", BIT<RegC>(4), 2},		{"BIT 4, D", BIT<RegD>(4), 2},			{"BIT 4, E", BIT<RegE>(4), 2},		{"BIT 4, H", BIT<RegH>(4), 2},		{"BIT 4, L", BIT<RegL>(4), 2},		{"BIT 4, (HL)", BIT(4, &HL), 4},	{"BIT 4, A", BIT<RegA>(4), 2},		{"BIT 5, B", BIT<RegB>(5), 2},			{"BIT 5, C", BIT<RegC>(5), 2},			{"BIT 5, D", BIT<RegD>(5), 2},			{"BIT 5, E", BIT<RegE>(5), 2},		{"BIT 5, H", BIT<RegH>(5), 2},			{"BIT 5, L", BIT<RegL>(5), 2},		{"BIT 5, (HL)", BIT(5, &HL), 4},	{"BIT 5, A", BIT<RegA>(5), 2}},
+		{{"BIT 6, B", BIT<RegB>(6), 2},	{"BIT 6, C", BIT<RegC>(6), 2},		{"BIT 6, D", BIT<RegD>(6), 2},			{"BIT 6, E", BIT<RegE>(6), 2},		{"BIT 6, H", BIT<RegH>(6), 2},		{"BIT 6, L", BIT<RegL>(6), 2},		{"BIT 6, (HL)", BIT(6, &HL), 4},	{"BIT 6, A", BIT<RegA>(6), 2},		{"BIT 7, B", BIT<RegB>(7), 2},			{"BIT 7, C", BIT<RegC>(7), 2},			{"BIT 7, D", BIT<RegD>(7), 2},			{"BIT 7, E", BIT<RegE>(7), 2},		{"BIT 7, H", BIT<RegH>(7), 2},			{"BIT 7, L", BIT<RegL>(7), 2},		{"BIT 7, (HL)", BIT(7, &HL), 4},	{"BIT 7, A", BIT<RegA>(7), 2}},
+		{{"RES 0, B", RES<RegB>(0), 2},	{"RES 0, C", RES<RegC>(0), 2},		{"RES 0, D", RES<RegD>(0), 2},			{"RES 0, E", RES<RegE>(0), 2},		{"RES 0, H", RES<RegH>(0), 2},		{"RES 0, L", RES<RegL>(0), 2},		{"RES 0, (HL)", RES(0, &HL), 4},	{"RES 0, A", RES<RegA>(0), 2},		{"RES 1, B", RES<RegB>(1), 2},			{"RES 1, C", RES<RegC>(1), 2},			{"RES 1, D", RES<RegD>(1), 2},			{"RES 1, E", RES<RegE>(1), 2},		{"RES 1, H", RES<RegH>(1), 2},			{"RES 1, L", RES<RegL>(1), 2},		{"RES 1, (HL)", RES(1, &HL), 4},	{"RES 1, A", RES<RegA>(1), 2}},
+		{{"RES 2, B", RES<RegB>(2), 2},	{"RES 2, C", RES<RegC>(2), 2},		{"RES 2, D", RES<RegD>(2), 2},			{"RES 2, E", RES<RegE>(2), 2},		{"RES 2, H", RES<RegH>(2), 2},		{"RES 2, L", RES<RegL>(2), 2},		{"RES 2, (HL)", RES(2, &HL), 4},	{"RES 2, A", RES<RegA>(2), 2},		{"RES 3, B", RES<RegB>(3), 2},			{"RES 3, C", RES<RegC>(3), 2},			{"RES 3, D", RES<RegD>(3), 2},			{"RES 3, E", RES<RegE>(3), 2},		{"RES 3, H", RES<RegH>(3), 2},			{"RES 3, L", RES<RegL>(3), 2},		{"RES 3, (HL)", RES(3, &HL), 4},	{"RES 3, A", RES<RegA>(3), 2}},
+		{{"RES 4, B", RES<RegB>(4), 2},	{"RES 4, C", RES<RegC>(4), 2},		{"RES 4, D", RES<RegD>(4), 2},			{"RES 4, E", RES<RegE>(4), 2},		{"RES 4, H", RES<RegH>(4), 2},		{"RES 4, L", RES<RegL>(4), 2},		{"RES 4, (HL)", RES(4, &HL), 4},	{"RES 4, A", RES<RegA>(4), 2},		{"RES 5, B", RES<RegB>(5), 2},			{"RES 5, C", RES<RegC>(5), 2},			{"RES 5, D", RES<RegD>(5), 2},			{"RES 5, E", RES<RegE>(5), 2},		{"RES 5, H", RES<RegH>(5), 2},			{"RES 5, L", RES<RegL>(5), 2},		{"RES 5, (HL)", RES(5, &HL), 4},	{"RES 5, A", RES<RegA>(5), 2}},
+		{{"RES 6, B", RES<RegB>(6), 2},	{"RES 6, C", RES<RegC>(6), 2},		{"RES 6, D", RES<RegD>(6), 2},			{"RES 6, E", RES<RegE>(6), 2},		{"RES 6, H", RES<RegH>(6), 2},		{"RES 6, L", RES<RegL>(6), 2},		{"RES 6, (HL)", RES(6, &HL), 4},	{"RES 6, A", RES<RegA>(6), 2},		{"RES 7, B", RES<RegB>(7), 2},			{"RES 7, C", RES<RegC>(7), 2},			{"RES 7, D", RES<RegD>(7), 2},			{"RES 7, E", RES<RegE>(7), 2},		{"RES 7, H", RES<RegH>(7), 2},			{"RES 7, L", RES<RegL>(7), 2},		{"RES 7, (HL)", RES(7, &HL), 4},	{"RES 7, A", RES<RegA>(7), 2}},
+		{{"SET 0, B", SET<RegB>(0), 2},	{"SET 0, C", SET<RegC>(0), 2},		{"SET 0, D", SET<RegD>(0), 2},			{"SET 0, E", SET<RegE>(0), 2},		{"SET 0, H", SET<RegH>(0), 2},		{"SET 0, L", SET<RegL>(0), 2},		{"SET 0, (HL)", SET(0, &HL), 4},	{"SET 0, A", SET<RegA>(0), 2},		{"SET 1, B", SET<RegB>(1), 2},			{"SET 1, C", SET<RegC>(1), 2},			{"SET 1, D", SET<RegD>(1), 2},			{"SET 1, E", SET<RegE>(1), 2},		{"SET 1, H", SET<RegH>(1), 2},			{"SET 1, L", SET<RegL>(1), 2},		{"SET 1, (HL)", SET(1, &HL), 4},	{"SET 1, A", SET<RegA>(1), 2}},
+		{{"SET 2, B", SET<RegB>(2), 2},	{"SET 2, C", SET<RegC>(2), 2},		{"SET 2, D", SET<RegD>(2), 2},			{"SET 2, E", SET<RegE>(2), 2},		{"SET 2, H", SET<RegH>(2), 2},		{"SET 2, L", SET<RegL>(2), 2},		{"SET 2, (HL)", SET(2, &HL), 4},	{"SET 2, A", SET<RegA>(2), 2},		{"SET 3, B", SET<RegB>(3), 2},			{"SET 3, C", SET<RegC>(3), 2},			{"SET 3, D", SET<RegD>(3), 2},			{"SET 3, E", SET<RegE>(3), 2},		{"SET 3, H", SET<RegH>(3), 2},			{"SET 3, L", SET<RegL>(3), 2},		{"SET 3, (HL)", SET(3, &HL), 4},	{"SET 3, A", SET<RegA>(3), 2}},
+		{{"SET 4, B", SET<RegB>(4), 2},	{"SET 4, C", SET<RegC>(4), 2},		{"SET 4, D", SET<RegD>(4), 2},			{"SET 4, E", SET<RegE>(4), 2},		{"SET 4, H", SET<RegH>(4), 2},		{"SET 4, L", SET<RegL>(4), 2},		{"SET 4, (HL)", SET(4, &HL), 4},	{"SET 4, A", SET<RegA>(4), 2},		{"SET 5, B", SET<RegB>(5), 2},			{"SET 5, C", SET<RegC>(5), 2},			{"SET 5, D", SET<RegD>(5), 2},			{"SET 5, E", SET<RegE>(5), 2},		{"SET 5, H", SET<RegH>(5), 2},			{"SET 5, L", SET<RegL>(5), 2},		{"SET 5, (HL)", SET(5, &HL), 4},	{"SET 5, A", SET<RegA>(5), 2}},
+		{{"SET 6, B", SET<RegB>(6), 2},	{"SET 6, C", SET<RegC>(6), 2},		{"SET 6, D", SET<RegD>(6), 2},			{"SET 6, E", SET<RegE>(6), 2},		{"SET 6, H", SET<RegH>(6), 2},		{"SET 6, L", SET<RegL>(6), 2},		{"SET 6, (HL)", SET(6, &HL), 4},	{"SET 6, A", SET<RegA>(6), 2},		{"SET 7, B", SET<RegB>(7), 2},			{"SET 7, C", SET<RegC>(7), 2},			{"SET 7, D", SET<RegD>(7), 2},			{"SET 7, E", SET<RegE>(7), 2},		{"SET 7, H", SET<RegH>(7), 2},			{"SET 7, L", SET<RegL>(7), 2},		{"SET 7, (HL)", SET(7, &HL), 4},	{"SET 7, A", SET<RegA>(7), 2}}
 	}};
 }
 
+CPU::~CPU() {
+	freeJitArena();
+}
+
 bool CPU::isStopped() {
 	return stopped;
 }
 
 void CPU::attachBus(Bus* bus) {
 	this->bus = bus;
+	// IF, the bus passes on IE (0xFFFF) itself
+	bus->registerIO(0xFF0F, nullptr, [this](u16, u8 val) { setInterruptRegisters(this->bus->read(0xFFFF), val); });
 }
 
+// Called before every instruction. Interrupts only cost anything while one
+// is requested or an EI is waiting to take effect.
 bool CPU::checkInterupt() {
-	u8 interruptEnableRegister = bus->read(0xFFFF);
-	u8 interruptFlagRegister = bus->read(0xFF0F);
-	u8 status = interruptEnableRegister & interruptFlagRegister;
+	if ((pendingInterrupts | imeDelay) == 0) return false;
+	if (imeDelay > 0 && --imeDelay == 0) interuptsEnabled = true;
+	if (pendingInterrupts == 0) return false;
 
-	if (!this->interuptsEnabled) return false;
-	Interrupt interrupt = NoInterrupt;
-	cout << "Handling Interrupt " << interrupt << endl;
-	if ((status & 0x1F) == 0) return false;
-	else if (status & VBlankInterrupt) {
-		interrupt = VBlankInterrupt;
-		bus->write(--SP.value, PC.high);
-		bus->write(--SP.value, PC.low);
-		PC.value = 0x0040;
-	}
-	else if (status & LCDCInterrupt) {
-		interrupt = LCDCInterrupt;
-		bus->write(--SP.value, PC.high);
-		bus->write(--SP.value, PC.low);
-		PC.value = 0x0048;
-	}
-	else if (status & TimerInterrupt) {
-		interrupt = TimerInterrupt;
-		bus->write(--SP.value, PC.high);
-		bus->write(--SP.value, PC.low);
-		PC.value = 0x0050;
-	}
-	else if (status & SerialInterrupt) {
-		interrupt = SerialInterrupt;
-		bus->write(--SP.value, PC.high);
-		bus->write(--SP.value, PC.low);
-		PC.value = 0x0058;
-	}
-	else if (status & JoypadInterrupt) {
-		interrupt = JoypadInterrupt;
-		bus->write(--SP.value, PC.high);
-		bus->write(--SP.value, PC.low);
-		PC.value = 0x0060;
-	}
+	// A requested interrupt ends HALT even if IME is off
 	stopped = false;
-	bus->write(0xff0f, interruptFlagRegister & ~interrupt);
+	if (!this->interuptsEnabled) return false;
+
+	// Lowest bit first: VBlank, LCDC, Timer, Serial, Joypad at 0x40..0x60
+	int n = 0;
+	while ((pendingInterrupts & (1 << n)) == 0) n++;
+	Interrupt interrupt = (Interrupt)(1 << n);
+	interuptsEnabled = false;
+	bus->write(--SP.value, PC.high);
+	bus->write(--SP.value, PC.low);
+	PC.value = 0x0040 + 8 * n;
+	bus->write(0xff0f, bus->read(0xff0f) & ~interrupt);
 	return true;
 }
 
-u8 CPU::fetch() {
-	return bus->read(PC.value++);
+// PC left the fetch window, look up the one it is in now
+u8 CPU::fetchSlow() {
+	fetchPage = bus->fetchWindow(PC.value, fetchStart, fetchSize);
+	if (fetchSize == 0) return bus->read(PC.value++);
+	return fetchPage[PC.value++ - fetchStart];
 }
 
-u16 CPU::doubleFetch() {
-	u8 first = fetch();
-	u8 last = fetch();
-	return last << 8 | first;
+// Runs instructions (servicing interrupts in between) until the CPU has used
+// at least cycleDeadline M-cycles in total. A halted CPU idles to the deadline.
+void CPU::runUntil(u64 cycleDeadline) {
+	if (engine == CPUEngine::Threaded) {
+		runThreaded(cycleDeadline);
+		return;
+	}
+	if (engine == CPUEngine::BlockCache || engine == CPUEngine::Dynarec) {
+		runCached(cycleDeadline);
+		return;
+	}
+	while (cycleCount < cycleDeadline) {
+		checkInterupt();
+		if (stopped) {
+			cycleCount = cycleDeadline;
+			return;
+		}
+		step();
+	}
 }
 
+// One instruction on any engine. Counts towards getCycles() like runUntil,
+// the bus times OAM DMA with it.
 int CPU::step() {
+	int cycles = (engine == CPUEngine::Table) ? stepTable() : stepSwitch();
+	cycleCount += cycles;
+	return cycles;
+}
+
+int CPU::stepTable() {
 	int cycles;
 	u8 instruction = fetch();
 	bool is16bit = false;
@@ -163,17 +166,8 @@ int CPU::step() {
 		//cout << std::dec << PC.value - 1 << " (" << std::hex << PC.value - 1 << ") : " << instructionDetails.name << endl;
 	}*/
 	//myfile << std::hex << PC.value << " " << AF.value << " " << BC.value << " " << DE.value << " " << HL.value << " " << SP.value << " " << std::endl;
-	s1.insert(instruction + is16bit * 0xCB00);
-	/*if (instructionDetails.name == "HALT" || instructionDetails.name == "STOP" || PC.value == 52037) {
-		set<int, greater<int> >::iterator itr;
-		cout << "\nThe set s1 is : \n";
-		for (auto& val : s1)
-		{
-			cout << hex << val << ' ';
-		}
-		cout << endl;
-	}*/
 	cycles += instructionDetails.fn();
+	profileOpcode(instruction + is16bit * 0x100, cycles);
 	return cycles;
 }
 
@@ -184,6 +178,7 @@ string decAndHex(u16 val) {
 }
 
 void CPU::printState() {
+	flushFlags();
 	cout << "AF: " << decAndHex(AF.value) << "BC: " << decAndHex(BC.value) << "DE: " << decAndHex(DE.value) << endl;
 	cout << "HL: " << decAndHex(HL.value) << "PC: " << decAndHex(PC.value) << "SP: " << decAndHex(SP.value) << endl;
 }
@@ -200,110 +195,92 @@ string CPU::nextInstruction() {
 	}*/
 }
 
-bool CPU::getFlag(FLAGS f) { return AF.low & f; }
-void CPU::setFlag(FLAGS f, bool v) { (v) ? AF.low |= f : AF.low &= ~f; }
-void CPU::clearFlags() { AF.low &= 0; }
-
-op CPU::SUB() {
-	return [&](u8* x, u8 y) {
-		/*setFlag(N, true);
-		int res = *x - y;
-		int carrybits = *x ^ y ^ res;
-		setFlag(C, (carrybits & 0x100) != 0);
-		setFlag(H, (carrybits & 0x10) != 0);
-		*x -= y;
-		setFlag(Z, *x == 0);*/
-		int result = *x - y;
-		int carrybits = *x ^ y ^ result;
-		*x = result;
-		clearFlags();
-		setFlag(N, true);
-		setFlag(Z, (result & 0xFF) == 0);
-		if ((carrybits & 0x100) != 0)
-		{
-			setFlag(C, true);
-		}
-		if ((carrybits & 0x10) != 0)
-		{
-			setFlag(H, true);
-		}
-	};
-}
-op CPU::ADC() {
-	return [&](u8* x, u8 y) {
-		/*int carry = getFlag(C);
-		int res = *x + y + carry;
-		clearFlags();
-		setFlag(C, res > 0xFF);
-		setFlag(H, ((*x & 0xF) + (y & 0xF) + carry > 0xF));
-		*x += y + carry;
-		setFlag(Z, *x == 0);*/
-		int carry = getFlag(C) ? 1 : 0;
-		int result = *x + y + carry;
-		clearFlags();
-		setFlag(Z, 0 == static_cast<u8> (result));
-		if (result > 0xFF)
-		{
-			setFlag(C, true);
-		}
-		if (((*x & 0x0F) + (y & 0x0F) + carry) > 0x0F)
-		{
-			setFlag(H, true);
-		}
-		*x = result;
-	};
-}
-op CPU::SBC() {
-	return [&](u8* x, u8 y) {
-		setFlag(N, true);
-		int carry = getFlag(C);
-		int res = *x - y - carry;
-		setFlag(C, res < 0);
-		setFlag(H, (int)(*x & 0xF) - (int)(y & 0xF) - carry < 0);
-		*x -= y + carry;
-		setFlag(Z, *x == 0);
-	};
-}
-op CPU::AND() {
-	return [&](u8* x, u8 y) {
-		/*clearFlags();
-		setFlag(H, true);
-		*x &= y;
-		setFlag(Z, *x == 0);*/
-		u8 result = *x & y;
-		*x = result;
-		clearFlags();
+void CPU::aluSUB(u8* x, u8 y) {
+	/*setFlag(N, true);
+	int res = *x - y;
+	int carrybits = *x ^ y ^ res;
+	setFlag(C, (carrybits & 0x100) != 0);
+	setFlag(H, (carrybits & 0x10) != 0);
+	*x -= y;
+	setFlag(Z, *x == 0);*/
+	int result = *x - y;
+	int carrybits = *x ^ y ^ result;
+	*x = result;
+	clearFlags();
+	setFlag(N, true);
+	setFlag(Z, (result & 0xFF) == 0);
+	if ((carrybits & 0x100) != 0)
+	{
+		setFlag(C, true);
+	}
+	if ((carrybits & 0x10) != 0)
+	{
 		setFlag(H, true);
-		setFlag(Z, result == 0);
-	};
-}
-op CPU::XOR() {
-	return [&](u8* x, u8 y) {
-		/*clearFlags();
-		*x ^= y;
-		setFlag(Z, *x == 0);*/
-		u8 result = *x ^ y;
-		AF.high = result;
-		clearFlags();
-		setFlag(Z, result == 0);
-	};
-}
-op CPU::OR() {
-	return [&](u8* x, u8 y) {
-		clearFlags();
-		*x |= y;
-		setFlag(Z, *x == 0);
-	};
+	}
 }
-op CPU::CP() {
-	return [&](u8* x, u8 y) {
-		setFlag(N, true);
-		int res = *x - y;
-		int carrybits = *x ^ y ^ res;
-		setFlag(C, *x < y);
-		setFlag(H, ((*x - y) & 0xF) > (*x & 0xF));
-		setFlag(Z, *x == y);
-	};
+void CPU::aluADC(u8* x, u8 y) {
+	/*int carry = getFlag(C);
+	int res = *x + y + carry;
+	clearFlags();
+	setFlag(C, res > 0xFF);
+	setFlag(H, ((*x & 0xF) + (y & 0xF) + carry > 0xF));
+	*x += y + carry;
+	setFlag(Z, *x == 0);*/
+	int carry = getFlag(C) ? 1 : 0;
+	int result = *x + y + carry;
+	clearFlags();
+	setFlag(Z, 0 == static_cast<u8> (result));
+	if (result > 0xFF)
+	{
+		setFlag(C, true);
+	}
+	if (((*x & 0x0F) + (y & 0x0F) + carry) > 0x0F)
+	{
+		setFlag(H, true);
+	}
+	*x = result;
+}
+void CPU::aluSBC(u8* x, u8 y) {
+	setFlag(N, true);
+	int carry = getFlag(C);
+	int res = *x - y - carry;
+	setFlag(C, res < 0);
+	setFlag(H, (int)(*x & 0xF) - (int)(y & 0xF) - carry < 0);
+	*x -= y + carry;
+	setFlag(Z, *x == 0);
+}
+void CPU::aluAND(u8* x, u8 y) {
+	/*clearFlags();
+	setFlag(H, true);
+	*x &= y;
+	setFlag(Z, *x == 0);*/
+	u8 result = *x & y;
+	*x = result;
+	clearFlags();
+	setFlag(H, true);
+	setFlag(Z, result == 0);
+}
+void CPU::aluXOR(u8* x, u8 y) {
+	/*clearFlags();
+	*x ^= y;
+	setFlag(Z, *x == 0);*/
+	u8 result = *x ^ y;
+	AF.high = result;
+	clearFlags();
+	setFlag(Z, result == 0);
+}
+void CPU::aluOR(u8* x, u8 y) {
+	clearFlags();
+	*x |= y;
+	setFlag(Z, *x == 0);
+}
+void CPU::aluCP(u8* x, u8 y) {
+	setFlag(N, true);
+	int res = *x - y;
+	int carrybits = *x ^ y ^ res;
+	setFlag(C, *x < y);
+	setFlag(H, ((*x - y) & 0xF) > (*x & 0xF));
+	setFlag(Z, *x == y);
 }
 
 function<bool()> CPU::COND(FLAGS f, bool val) { return [&, f, val]() { return getFlag(f) == val; }; }
@@ -317,9 +294,10 @@ function<int()> CPU::LD(Register* reg) {
 	};
 }
 
-function<int()> CPU::LD(Register* addr, u8* reg) {
-	return [&, addr, reg]() {
-		bus->write(addr->value, *reg);
+template<u8 R>
+function<int()> CPU::ST(Register* addr) {
+	return [&, addr]() {
+		bus->write(addr->value, r8<R>());
 		return 0;
 	};
 }
@@ -331,98 +309,111 @@ function<int()> CPU::LD(Register* reg1, Register* reg2) {
 	};
 }
 
-std::function<int()> CPU::LD(u8* reg, Register* addr) {
-	return [&, reg, addr]() {
-		*reg = bus->read(addr->value);
+template<u8 R>
+function<int()> CPU::LD(Register* addr) {
+	return [&, addr]() {
+		r8<R>() = bus->read(addr->value);
 		return 0;
 	};
 }
 
-function<int()> CPU::LD(u8* reg) {
-	return [&, reg]() {
-		*reg = fetch();
+template<u8 R>
+function<int()> CPU::LD() {
+	return [&]() {
+		r8<R>() = fetch();
 		return 0;
 	};
 }
 
-function<int()> CPU::LD(u8* reg1, u8* reg2) {
-	return [&, reg1, reg2]() {
-		*reg1 = *reg2;
+template<u8 R1, u8 R2>
+function<int()> CPU::LD() {
+	return [&]() {
+		r8<R1>() = r8<R2>();
 		return 0;
 	};
 }
 
-function<int()> CPU::LDI(Register* addr, u8* reg) {
-	return [&, addr, reg]() {
-		bus->write(addr->value, *reg);
+template<u8 R>
+function<int()> CPU::STI(Register* addr) {
+	return [&, addr]() {
+		bus->write(addr->value, r8<R>());
 		addr->value++;
 		return 0;
 	};
 }
 
-function<int()> CPU::LDI(u8* reg, Register* addr) {
-	return [&, reg, addr]() {
-		*reg = bus->read(addr->value);
+template<u8 R>
+function<int()> CPU::LDI(Register* addr) {
+	return [&, addr]() {
+		r8<R>() = bus->read(addr->value);
 		addr->value++;
 		return 0;
 	};
 }
 
-function<int()> CPU::LDD(Register* addr, u8* reg) {
-	return [&, addr, reg]() {
-		bus->write(addr->value, *reg);
+template<u8 R>
+function<int()> CPU::STD(Register* addr) {
+	return [&, addr]() {
+		bus->write(addr->value, r8<R>());
 		addr->value--;
 		return 0;
 	};
 }
 
-function<int()> CPU::LDD(u8* reg, Register* addr) {
-	return [&, reg, addr]() {
-		*reg = bus->read(addr->value);
+template<u8 R>
+function<int()> CPU::LDD(Register* addr) {
+	return [&, addr]() {
+		r8<R>() = bus->read(addr->value);
 		addr->value--;
 		return 0;
 	};
 }
 
-function<int()> CPU::LDH(u8* reg) {
-	return [&, reg]() {
+template<u8 R>
+function<int()> CPU::LDH() {
+	return [&]() {
 		u8 val = fetch();
-		*reg = bus->read(val + 0xFF00);
+		r8<R>() = bus->read(val + 0xFF00);
 		return 0;
 	};
 }
 
-function<int()> CPU::LDH(u8* reg1, u8* reg2) {
-	return [&, reg1, reg2]() {
-		*reg1 = bus->read(*reg2 + 0xFF00);
+template<u8 R1, u8 R2>
+function<int()> CPU::LDH() {
+	return [&]() {
+		r8<R1>() = bus->read(r8<R2>() + 0xFF00);
 		return 0;
 	};
 }
 
-function<int()> CPU::STH(u8* reg) {
-	return [&, reg]() {
-		bus->write(fetch() + 0xFF00, *reg);
+template<u8 R>
+function<int()> CPU::STH() {
+	return [&]() {
+		bus->write(fetch() + 0xFF00, r8<R>());
 		return 0;
 	};
 }
 
-function<int()> CPU::STH(u8* reg1, u8* reg2) {
-	return [&, reg1, reg2]() {
-		bus->write(*reg1 + 0xFF00, *reg2);
+template<u8 R1, u8 R2>
+function<int()> CPU::STH() {
+	return [&]() {
+		bus->write(r8<R1>() + 0xFF00, r8<R2>());
 		return 0;
 	};
 }
 
-function<int()> CPU::LDA(u8* reg) {
-	return [&, reg]() {
-		*reg = bus->read(doubleFetch());
+template<u8 R>
+function<int()> CPU::LDA() {
+	return [&]() {
+		r8<R>() = bus->read(doubleFetch());
 		return 0;
 	};
 }
 
-function<int()> CPU::STA(u8* reg) {
-	return [&, reg]() {
-		bus->write(doubleFetch(), *reg);
+template<u8 R>
+function<int()> CPU::STA() {
+	return [&]() {
+		bus->write(doubleFetch(), r8<R>());
 		return 0;
 	};
 }
@@ -469,9 +460,10 @@ function<int()> CPU::ADD() {
 	};
 }
 
-function<int()> CPU::ADD(u8* reg) {
-	return [&, reg]() {
-		u8 val = *reg;
+template<u8 R>
+function<int()> CPU::ADD() {
+	return [&]() {
+		u8 val = r8<R>();
 		clearFlags();
 		setFlag(H, checkHalfCarry(AF.high, val));
 		setFlag(C, checkCarry(AF.high, val));
@@ -481,14 +473,15 @@ function<int()> CPU::ADD(u8* reg) {
 	};
 }
 
-function<int()> CPU::ADD(u8* reg, Register* addr) {
-	return [&, reg, addr]() {
+template<u8 R>
+function<int()> CPU::ADD(Register* addr) {
+	return [&, addr]() {
 		u8 val = bus->read(addr->value);
 		clearFlags();
-		setFlag(H, checkHalfCarry(*reg, val));
-		setFlag(C, checkCarry(*reg, val));
-		*reg += val;
-		setFlag(Z, *reg == 0);
+		setFlag(H, checkHalfCarry(r8<R>(), val));
+		setFlag(C, checkCarry(r8<R>(), val));
+		r8<R>() += val;
+		setFlag(Z, r8<R>() == 0);
 		return 0;
 	};
 }
@@ -555,23 +548,26 @@ function<int()> CPU::POP(Register* reg) {
 	};
 }
 
-function<int()> CPU::OP(op f) {
-	return [&, f]() {
-		f(&(AF.high), fetch());
+template<void (CPU::*F)(u8*, u8)>
+function<int()> CPU::OP() {
+	return [&]() {
+		(this->*F)(&(AF.high), fetch());
 		return 0;
 	};
 }
 
-function<int()> CPU::OP(u8* reg, op f) {
-	return [&, reg, f]() {
-		f(&(AF.high), *reg);
+template<u8 R, void (CPU::*F)(u8*, u8)>
+function<int()> CPU::OP() {
+	return [&]() {
+		(this->*F)(&(AF.high), r8<R>());
 		return 0;
 	};
 }
 
-function<int()> CPU::OP(Register* reg, op f) {
-	return [&, reg, f]() {
-		f(&(AF.high), bus->read(reg->value));
+template<void (CPU::*F)(u8*, u8)>
+function<int()> CPU::OP(Register* reg) {
+	return [&, reg]() {
+		(this->*F)(&(AF.high), bus->read(reg->value));
 		return 0;
 	};
 }
@@ -588,12 +584,13 @@ function<int()> CPU::INC() {
 	};
 }
 
-function<int()> CPU::INC(u8* reg) {
-	return [&, reg]() {
-		int val = *reg;
-		(*reg)++;
+template<u8 R>
+function<int()> CPU::INC() {
+	return [&]() {
+		int val = r8<R>();
+		(r8<R>())++;
 		setFlag(N, false);
-		setFlag(Z, *reg == 0);
+		setFlag(Z, r8<R>() == 0);
 		setFlag(H, (val & 0xF) + 1 > 0xF);
 		return 0;
 	};
@@ -618,12 +615,13 @@ function<int()> CPU::DEC() {
 	};
 }
 
-function<int()> CPU::DEC(u8* reg) {
-	return [&, reg]() {
-		int val = *reg;
-		(*reg)--;
+template<u8 R>
+function<int()> CPU::DEC() {
+	return [&]() {
+		int val = r8<R>();
+		(r8<R>())--;
 		setFlag(N, true);
-		setFlag(Z, *reg == 0);
+		setFlag(Z, r8<R>() == 0);
 		setFlag(H, (val & 0xF) - 1 < 0);
 		return 0;
 	};
@@ -709,27 +707,29 @@ function<int()> CPU::RET() {
 function<int()> CPU::RETI() {
 	return [&]() {
 		RET()();
-		EI()();
+		interuptsEnabled = true;
 		return 0;
 	};
 }
 
-function<int()> CPU::CPL(u8* reg) {
-	return [&, reg]() {
-		*reg = ~(*reg);
+template<u8 R>
+function<int()> CPU::CPL() {
+	return [&]() {
+		r8<R>() = ~(r8<R>());
 		setFlag(N, true);
 		setFlag(H, true);
 		return 0;
 	};
 }
 
-function<int()> CPU::RL(u8* reg, bool isA) {
-	return [&, reg, isA]() {
-		u8 top = *reg >> 7;
-		*reg = (*reg << 1) | getFlag(C);
+template<u8 R, bool isA>
+function<int()> CPU::RL() {
+	return [&]() {
+		u8 top = r8<R>() >> 7;
+		r8<R>() = (r8<R>() << 1) | getFlag(C);
 		clearFlags();
 		setFlag(C, top);
-		setFlag(Z, *reg == 0);
+		setFlag(Z, r8<R>() == 0);
 		if (isA) setFlag(Z, false);
 		return 0;
 	};
@@ -749,21 +749,22 @@ function<int()> CPU::RL(Register* reg) {
 	};
 }
 
-function<int()> CPU::RLC(u8* reg, bool isA) {
-	return [&, reg, isA]() {
-		u8 top = *reg >> 7;
-		*reg = (*reg << 1) | top;
+template<u8 R, bool isA>
+function<int()> CPU::RLC() {
+	return [&]() {
+		u8 top = r8<R>() >> 7;
+		r8<R>() = (r8<R>() << 1) | top;
 		clearFlags();
 		setFlag(C, top);
-		setFlag(Z, *reg == 0);
+		setFlag(Z, r8<R>() == 0);
 		if (isA) setFlag(Z, false);
 		return 0;
 
 
-		/*setFlag(C, *reg >> 7);
-		*reg = (*reg << 1) | getFlag(C);
+		/*setFlag(C, r8<R>() >> 7);
+		r8<R>() = (r8<R>() << 1) | getFlag(C);
 		clearFlags();
-		setFlag(Z, *reg == 0);
+		setFlag(Z, r8<R>() == 0);
 		if (isA) setFlag(Z, false);
 		return 0;*/
 	};
@@ -783,13 +784,14 @@ function<int()> CPU::RLC(Register* reg) {
 	};
 }
 
-function<int()> CPU::RR(u8* reg, bool isA) {
-	return [&, reg, isA]() {
+template<u8 R, bool isA>
+function<int()> CPU::RR() {
+	return [&]() {
 		u8 carry = getFlag(C) ? 1 : 0;
-		u8 bottom = *reg & 0x1;
-		*reg = (*reg >> 1) | (carry << 7);
+		u8 bottom = r8<R>() & 0x1;
+		r8<R>() = (r8<R>() >> 1) | (carry << 7);
 		clearFlags();
-		setFlag(Z, *reg == 0);
+		setFlag(Z, r8<R>() == 0);
 		setFlag(C, bottom);
 		if (isA) setFlag(Z, false);
 		return 0;
@@ -810,12 +812,13 @@ function<int()> CPU::RR(Register* reg) {
 	};
 }
 
-function<int()> CPU::RRC(u8* reg, bool isA) {
-	return [&, reg, isA]() {
+template<u8 R, bool isA>
+function<int()> CPU::RRC() {
+	return [&]() {
 		clearFlags();
-		setFlag(C, *reg & 0x1);
-		*reg = (*reg >> 1) | (getFlag(C) << 7);
-		setFlag(Z, *reg == 0);
+		setFlag(C, r8<R>() & 0x1);
+		r8<R>() = (r8<R>() >> 1) | (getFlag(C) << 7);
+		setFlag(Z, r8<R>() == 0);
 		if (isA) setFlag(Z, false);
 		return 0;
 	};
@@ -834,17 +837,18 @@ function<int()> CPU::RRC(Register* reg) {
 	};
 }
 
-function<int()> CPU::RLCA() { return RLC(&(AF.high), true); }
-function<int()> CPU::RLA() { return RL(&(AF.high), true); }
-function<int()> CPU::RRCA() { return RRC(&(AF.high), true); }
-function<int()> CPU::RRA() { return RR(&(AF.high), true); }
+function<int()> CPU::RLCA() { return RLC<RegA, true>(); }
+function<int()> CPU::RLA() { return RL<RegA, true>(); }
+function<int()> CPU::RRCA() { return RRC<RegA, true>(); }
+function<int()> CPU::RRA() { return RR<RegA, true>(); }
 
-function<int()> CPU::SLA(u8* reg) {
-	return [&, reg]() {
+template<u8 R>
+function<int()> CPU::SLA() {
+	return [&]() {
 		clearFlags();
-		setFlag(C, *reg >> 7);
-		*reg = (*reg << 1) & 0xFE;
-		setFlag(Z, *reg == 0);
+		setFlag(C, r8<R>() >> 7);
+		r8<R>() = (r8<R>() << 1) & 0xFE;
+		setFlag(Z, r8<R>() == 0);
 		return 0;
 	};
 }
@@ -862,14 +866,15 @@ function<int()> CPU::SLA(Register* reg) {
 	};
 }
 
-function<int()> CPU::SRA(u8* reg) {
-	return [&, reg]() {
+template<u8 R>
+function<int()> CPU::SRA() {
+	return [&]() {
 		clearFlags();
-		u8 bottom = *reg & 0x1;
-		u8 top = *reg & 0x80;
+		u8 bottom = r8<R>() & 0x1;
+		u8 top = r8<R>() & 0x80;
 		setFlag(C, bottom > 0);
-		*reg = (*reg >> 1) | top;
-		setFlag(Z, *reg == 0);
+		r8<R>() = (r8<R>() >> 1) | top;
+		setFlag(Z, r8<R>() == 0);
 		return 0;
 	};
 }
@@ -889,13 +894,14 @@ function<int()> CPU::SRA(Register* reg) {
 	};
 }
 
-function<int()> CPU::SRL(u8* reg) {
-	return [&, reg]() {
+template<u8 R>
+function<int()> CPU::SRL() {
+	return [&]() {
 		clearFlags();
-		u8 bottom = *reg & 0x1;
+		u8 bottom = r8<R>() & 0x1;
 		setFlag(C, bottom > 0);
-		*reg = *reg >> 1;
-		setFlag(Z, *reg == 0);
+		r8<R>() = r8<R>() >> 1;
+		setFlag(Z, r8<R>() == 0);
 		return 0;
 	};
 }
@@ -914,17 +920,18 @@ function<int()> CPU::SRL(Register* reg) {
 	};
 }
 
-function<int()> CPU::SWAP(u8* reg) {
-	return [&, reg]() {
-		/*u8 res = (*reg >> 4) | (*reg << 4);
-		*reg = res;
+template<u8 R>
+function<int()> CPU::SWAP() {
+	return [&]() {
+		/*u8 res = (r8<R>() >> 4) | (r8<R>() << 4);
+		r8<R>() = res;
 		clearFlags();
 		setFlag(Z, res == 0);*/
-		u8 low_half = *reg & 0x0F;
-		u8 high_half = (*reg >> 4) & 0x0F;
-		*reg = (low_half << 4) + high_half;
+		u8 low_half = r8<R>() & 0x0F;
+		u8 high_half = (r8<R>() >> 4) & 0x0F;
+		r8<R>() = (low_half << 4) + high_half;
 		clearFlags();
-		setFlag(Z, *reg == 0);
+		setFlag(Z, r8<R>() == 0);
 		return 0;
 	};
 }
@@ -941,9 +948,10 @@ function<int()> CPU::SWAP(Register* reg) {
 	};
 }
 
-function<int()> CPU::BIT(u8 bitNumber, u8* reg) {
-	return [&, bitNumber, reg]() {
-		setFlag(Z, ((*reg >> bitNumber) & 0x1) == 0);
+template<u8 R>
+function<int()> CPU::BIT(u8 bitNumber) {
+	return [&, bitNumber]() {
+		setFlag(Z, ((r8<R>() >> bitNumber) & 0x1) == 0);
 		setFlag(N, false);
 		setFlag(H, true);
 		return 0;
@@ -961,9 +969,10 @@ function<int()> CPU::BIT(u8 bitNumber, Register* reg) {
 	};
 }
 
-function<int()> CPU::SET(u8 bitNumber, u8* reg) {
-	return [&, bitNumber, reg]() {
-		*reg |= 0x1 << bitNumber;
+template<u8 R>
+function<int()> CPU::SET(u8 bitNumber) {
+	return [&, bitNumber]() {
+		r8<R>() |= 0x1 << bitNumber;
 		return 0;
 	};
 }
@@ -977,9 +986,10 @@ function<int()> CPU::SET(u8 bitNumber, Register* reg) {
 	};
 }
 
-function<int()> CPU::RES(u8 bitNumber, u8* reg) {
-	return [&, bitNumber, reg]() {
-		*reg &= ~(0x1 << bitNumber);
+template<u8 R>
+function<int()> CPU::RES(u8 bitNumber) {
+	return [&, bitNumber]() {
+		r8<R>() &= ~(0x1 << bitNumber);
 		return 0;
 	};
 }
@@ -1014,13 +1024,15 @@ function<int()> CPU::SCF() {
 function<int()> CPU::DI() {
 	return [&]() {
 		interuptsEnabled = false;
+		imeDelay = 0;
 		return 0;
 	};
 }
 
 function<int()> CPU::EI() {
 	return [&]() {
-		interuptsEnabled = true;
+		// IME is set after the next instruction
+		imeDelay = 2;
 		return 0;
 	};
 }
@@ -3,19 +3,50 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <bitset>
+#include <unordered_map>
 
 #include "definitions.h"
 
 class Bus;
 
-typedef std::function<void(u8*, u8)> op;
-
 struct Instruction {
     std::string name;
     std::function<int()> fn;
     int cycles;
 };
 
+// Frequent instruction sequences run by one handler (CPUFusion.cpp)
+enum class FusedOp : u8
+{
+    None,
+    DecJrNz,    // DEC r; JR NZ, s8
+    LdhTest,    // LDH A, (a8); AND A / AND d8 / CP d8
+    LdhTestJr,  // LdhTest followed by JR Z, s8 / JR NZ, s8
+    CopyHLI,    // LD A, (HL+); LD (DE), A
+    TestBCJrNz, // LD A, B; OR C; JR NZ, s8
+    Count
+};
+
+struct DecodedOp {
+    u8 opcode;
+    u8 length;
+    u16 operand; // immediate, or the second byte of a CB instruction
+    FusedOp fused = FusedOp::None; // set on the first op of a fused sequence
+    u8 span = 1;                   // number of ops the fused handler covers
+};
+
+struct Block {
+    std::vector<DecodedOp> ops;
+    u16 start;
+    u16 end; // one past the last byte
+
+    void* code = nullptr;       // dynarec translation, if any
+    u32 hits = 0;
+    bool interpretOnly = false; // never translated (touches I/O registers)
+    bool idleLoop = false;      // polls memory without side effects (isIdleLoop)
+};
+
 union Register
 {
     u16 value;
@@ -48,6 +79,57 @@ enum FLAGS
     Z = (1 << 7),	// Zero
 };
 
+// ALU instructions in the CPUOpcodes.inl engines record their operands and
+// compute Z/N/H/C only when F is read (see CPU::evalFlags)
+#ifndef CPU_LAZY_FLAGS
+#define CPU_LAZY_FLAGS 1
+#endif
+
+// 8-bit registers as numbered in the opcode encoding, 6 is (HL)
+enum Reg8 : u8
+{
+    RegB = 0,
+    RegC = 1,
+    RegD = 2,
+    RegE = 3,
+    RegH = 4,
+    RegL = 5,
+    RegA = 7
+};
+
+// Counts executed opcodes and their cycles (CPUProfile.cpp). Compiled out
+// unless defined to 1.
+#ifndef CPU_PROFILE_OPCODES
+#define CPU_PROFILE_OPCODES 0
+#endif
+
+enum class FlagOp : u8
+{
+    None,   // AF.low is up to date
+    Add,    // ADD, ADC
+    Sub,    // SUB, SBC, CP
+    And,
+    Or,     // OR, XOR
+    Inc,
+    Dec
+};
+
+struct LazyFlags {
+    FlagOp op = FlagOp::None;
+    u8 a;     // first operand (the value before INC/DEC)
+    u8 b;     // second operand
+    u8 carry; // carry in for ADC/SBC, the preserved C for INC/DEC
+};
+
+enum class CPUEngine
+{
+    Table,      // std::function lookup table
+    Switch,     // flat switch over CPUOpcodes.inl
+    Threaded,   // computed-goto dispatch over CPUOpcodes.inl (switch if unsupported)
+    BlockCache, // pre-decoded basic blocks (CPUBlockCache.cpp)
+    Dynarec     // block cache with hot blocks translated to x86-64 (CPUDynarec.cpp)
+};
+
 class CPU {
 private:
     Register AF = { 0x11b0 };
@@ -58,65 +140,139 @@ private:
     Register PC = { 0x0100 };
 
     bool interuptsEnabled = false;
+    u8 imeDelay = 0;          // interrupt checks left until an EI takes effect
+    u8 pendingInterrupts = 0; // IE & IF, kept current by the bus (setInterruptRegisters)
     bool stopped = false;
+    LazyFlags lazy;
+    u64 cycleCount = 0; // M-cycles executed by runUntil
 
+    CPUEngine engine;
     std::vector<std::vector<std::vector<Instruction>>> lookup;
 
+    std::unordered_map<u32, Block> blocks;
+    struct BlockSlot { u32 key; Block* block = nullptr; };
+    static const int RECENT_BLOCKS = 64;
+    BlockSlot recentBlocks[RECENT_BLOCKS]; // direct-mapped on the start address, in front of blocks
+    std::bitset<0x800> codeLines;  // 16-byte lines of 0x8000-0xFFFF holding cached code
+    std::bitset<0x800> staleLines; // lines written since the last purge
+    bool codeDirty = false;
+    bool idleLoopSkip = true; // skip repeated passes of idle loops in runCached
+    bool idling = false;      // the last runCached ended spinning in an idle loop
+
+    u8* jitArena = nullptr;
+    size_t jitUsed = 0;
+    bool jitExit = false; // a called instruction must end the native block
+
+#if CPU_PROFILE_OPCODES
+    u64 opcodeCounts[512] = {}; // CB-prefixed opcodes at 0x100 + n
+    u64 opcodeCycles[512] = {};
+    u64 fusedCounts[(int)FusedOp::Count] = {};
+#endif
+    void profileOpcode([[maybe_unused]] u16 opcode, [[maybe_unused]] int cycles) {
+#if CPU_PROFILE_OPCODES
+        opcodeCounts[opcode]++;
+        opcodeCycles[opcode] += cycles;
+#endif
+    }
+
     Bus* bus = nullptr;
-    u8 fetch();
-    u16 doubleFetch();
+
+    // Host memory PC currently fetches from, see Bus::fetchWindow. Empty when
+    // PC is somewhere reads must go through the bus.
+    const u8* fetchPage = nullptr;
+    u16 fetchStart = 0;
+    u16 fetchSize = 0;
+
+    u8 fetch() {
+        u16 offset = PC.value - fetchStart;
+        if (offset < fetchSize) {
+            PC.value++;
+            return fetchPage[offset];
+        }
+        return fetchSlow();
+    }
+    u16 doubleFetch() {
+        u16 offset = PC.value - fetchStart;
+        if (offset + 1 < fetchSize) {
+            PC.value += 2;
+            return fetchPage[offset + 1] << 8 | fetchPage[offset];
+        }
+        u8 first = fetch();
+        u8 last = fetch();
+        return last << 8 | first;
+    }
+    u8 fetchSlow();
 
     u8* getRegister(u8 i);
-    bool getFlag(FLAGS f);
-    void setFlag(FLAGS f, bool v);
-    void clearFlags();
-
-    op SUB();
-    op ADC();
-    op SBC();
-    op AND();
-    op XOR();
-    op OR();
-    op CP();
+
+    // Register operand of the lookup table handlers, resolved at compile time
+    template<u8 R> u8& r8() {
+        if constexpr (R == RegB) return BC.high;
+        else if constexpr (R == RegC) return BC.low;
+        else if constexpr (R == RegD) return DE.high;
+        else if constexpr (R == RegE) return DE.low;
+        else if constexpr (R == RegH) return HL.high;
+        else if constexpr (R == RegL) return HL.low;
+        else return AF.high;
+    }
+#if CPU_LAZY_FLAGS
+    void flushFlags() { if (lazy.op != FlagOp::None) evalFlags(); }
+#else
+    void flushFlags() {}
+#endif
+    void evalFlags();
+    u8 carryFlag();
+    bool getFlag(FLAGS f) { flushFlags(); return AF.low & f; }
+    void setFlag(FLAGS f, bool v) { flushFlags(); (v) ? AF.low |= f : AF.low &= ~f; }
+    void clearFlags() { lazy.op = FlagOp::None; AF.low &= 0; }
+
+    // 8-bit ALU operations of the lookup table, A is always x
+    void aluSUB(u8* x, u8 y);
+    void aluADC(u8* x, u8 y);
+    void aluSBC(u8* x, u8 y);
+    void aluAND(u8* x, u8 y);
+    void aluXOR(u8* x, u8 y);
+    void aluOR(u8* x, u8 y);
+    void aluCP(u8* x, u8 y);
 
     std::function<bool()> COND(FLAGS f, bool val = true);
 
     std::function<int()> NOP();
     std::function<int()> LD(Register* reg);
-    std::function<int()> LD(Register* addr, u8* reg);
+    template<u8 R> std::function<int()> ST(Register* addr);
     std::function<int()> LD(Register* reg1, Register* reg2);
-    std::function<int()> LD(u8* reg, Register* addr);
-    std::function<int()> LD(u8* reg);
-    std::function<int()> LD(u8* reg1, u8* reg2);
-    std::function<int()> LDI(Register* addr, u8* reg);
-    std::function<int()> LDI(u8* reg, Register* addr);
-    std::function<int()> LDD(Register* addr, u8* reg);
-    std::function<int()> LDD(u8* reg, Register* addr);
-    std::function<int()> LDH(u8* reg);
-    std::function<int()> LDH(u8* reg1, u8* reg2);
-    std::function<int()> STH(u8* reg);
-    std::function<int()> STH(u8* reg1, u8* reg2);
-    std::function<int()> LDA(u8* reg);
-    std::function<int()> STA(u8* reg);
+    template<u8 R> std::function<int()> LD(Register* addr);
+    template<u8 R> std::function<int()> LD();
+    template<u8 R1, u8 R2> std::function<int()> LD();
+    template<u8 R> std::function<int()> STI(Register* addr);
+    template<u8 R> std::function<int()> LDI(Register* addr);
+    template<u8 R> std::function<int()> STD(Register* addr);
+    template<u8 R> std::function<int()> LDD(Register* addr);
+    template<u8 R> std::function<int()> LDH();
+    template<u8 R1, u8 R2> std::function<int()> LDH();
+    template<u8 R> std::function<int()> STH();
+    template<u8 R1, u8 R2> std::function<int()> STH();
+    template<u8 R> std::function<int()> LDA();
+    template<u8 R> std::function<int()> STA();
     std::function<int()> ST(Register* reg);
     std::function<int()> STSP(Register* reg);
     std::function<int()> LDHL(Register* reg1, Register* reg2);
     std::function<int()> ADD();
-    std::function<int()> ADD(u8* reg);
-    std::function<int()> ADD(u8* reg, Register* addr);
+    template<u8 R> std::function<int()> ADD();
+    template<u8 R> std::function<int()> ADD(Register* addr);
     std::function<int()> ADD(Register* reg);
     std::function<int()> ADD(Register* reg1, Register* reg2);
     std::function<int()> PUSH(Register* reg);
     std::function<int()> POP();
     std::function<int()> POP(Register* reg);
-    std::function<int()> OP(op f);
-    std::function<int()> OP(u8* reg, op f);
-    std::function<int()> OP(Register* reg, op f);
+    template<void (CPU::*F)(u8*, u8)> std::function<int()> OP();
+    template<u8 R, void (CPU::*F)(u8*, u8)> std::function<int()> OP();
+    template<void (CPU::*F)(u8*, u8)> std::function<int()> OP(Register* reg);
     std::function<int()> INC();
-    std::function<int()> INC(u8* reg);
+    template<u8 R> std::function<int()> INC();
     std::function<int()> INC(Register* reg);
     std::function<int()> DEC();
-    std::function<int()> DEC(u8* reg);
+    template<u8 R> std::function<int()> DEC();
     std::function<int()> DEC(Register* reg);
     std::function<int()> JR(std::function<bool()> cond);
     std::function<int()> JP(std::function<bool()> cond);
@@ -126,32 +282,32 @@ private:
     std::function<int()> RET();
     std::function<int()> RETI();
     std::function<int()> DAA();
-    std::function<int()> CPL(u8* reg);
+    template<u8 R> std::function<int()> CPL();
     std::function<int()> RLCA();
     std::function<int()> RLA();
     std::function<int()> RRCA();
     std::function<int()> RRA();
-    std::function<int()> RLC(u8* reg, bool isA = false);
+    template<u8 R, bool isA = false> std::function<int()> RLC();
     std::function<int()> RLC(Register* reg);
-    std::function<int()> RL(u8* reg, bool isA = false);
+    template<u8 R, bool isA = false> std::function<int()> RL();
     std::function<int()> RL(Register* reg);
-    std::function<int()> RRC(u8* reg, bool isA = false);
+    template<u8 R, bool isA = false> std::function<int()> RRC();
     std::function<int()> RRC(Register* reg);
-    std::function<int()> RR(u8* reg, bool isA = false);
+    template<u8 R, bool isA = false> std::function<int()> RR();
     std::function<int()> RR(Register* reg);
-    std::function<int()> SLA(u8* reg);
+    template<u8 R> std::function<int()> SLA();
     std::function<int()> SLA(Register* reg);
-    std::function<int()> SRA(u8* reg);
+    template<u8 R> std::function<int()> SRA();
     std::function<int()> SRA(Register* reg);
-    std::function<int()> SRL(u8* reg);
+    template<u8 R> std::function<int()> SRL();
     std::function<int()> SRL(Register* reg);
-    std::function<int()> SWAP(u8* reg);
+    template<u8 R> std::function<int()> SWAP();
     std::function<int()> SWAP(Register* reg);
-    std::function<int()> BIT(u8 bitNumber, u8* reg);
+    template<u8 R> std::function<int()> BIT(u8 bitNumber);
     std::function<int()> BIT(u8 bitNumber, Register* reg);
-    std::function<int()> SET(u8 bitNumber, u8* reg);
+    template<u8 R> std::function<int()> SET(u8 bitNumber);
     std::function<int()> SET(u8 bitNumber, Register* reg);
-    std::function<int()> RES(u8 bitNumber, u8* reg);
+    template<u8 R> std::function<int()> RES(u8 bitNumber);
     std::function<int()> RES(u8 bitNumber, Register* reg);
     std::function<int()> CCF();
     std::function<int()> SCF();
@@ -162,13 +318,86 @@ private:
     std::function<int()> RST(int x);
     std::function<int()> XXX();
 
+    int stepTable();
+
+    // Switch engine (CPUSwitch.cpp)
+    int stepSwitch();
+    void runThreaded(u64 cycleDeadline);
+    void runCached(u64 cycleDeadline);
+    int executeDecoded(const DecodedOp& op);
+    int executeCB(u8 instruction);
+    u8 readR8(u8 index);
+    void writeR8(u8 index, u8 val);
+    void push(Register& reg);
+    void pop(Register& reg);
+
+    // ALU and rotate helpers of the switch, threaded and cached engines (CPUSwitch.cpp)
+    void add8(u8 val);
+    void adc8(u8 val);
+    void sub8(u8 val);
+    void sbc8(u8 val);
+    void and8(u8 val);
+    void xor8(u8 val);
+    void or8(u8 val);
+    void cp8(u8 val);
+    u8 inc8(u8 val);
+    u8 dec8(u8 val);
+    void addHL(u16 val);
+    void addSP(s8 val);
+    void ldHLSP(s8 val);
+    void daa();
+    u8 rlc8(u8 val);
+    u8 rl8(u8 val);
+    u8 rrc8(u8 val);
+    u8 rr8(u8 val);
+    u8 sla8(u8 val);
+    u8 sra8(u8 val);
+    u8 srl8(u8 val);
+    u8 swap8(u8 val);
+
+    // Block cache (CPUBlockCache.cpp)
+    u32 blockKey(u16 addr);
+    Block& getBlock(u16 addr);
+    void purgeStaleBlocks();
+
+    // Superinstructions (CPUFusion.cpp)
+    void fuseBlock(Block& block);
+    bool canRunFused(u64 cycleDeadline) const;
+    int executeFused(const DecodedOp* ops);
+
+    // Dynarec (CPUDynarec.cpp)
+    static void jitStep(CPU* cpu, u32 packed);
+    static u8 jitRead(CPU* cpu, u16 addr);
+    static u8 jitFlags(CPU* cpu); // evaluates the lazy flags, returns F
+    u8* jitRegister(u8 index);
+    void compileBlock(Block& block);
+    bool runNative(Block& block, u64 cycleDeadline, bool& completed);
+    void freeJitArena();
+
 public:
-	CPU();
+	CPU(CPUEngine engine = CPUEngine::Table);
+    ~CPU();
 	int step();
+    void runUntil(u64 cycleDeadline);
+    u64 getCycles() { return cycleCount; }
     std::string nextInstruction();
     void attachBus(Bus* bus);
     bool isStopped();
+    bool isIdling() { return idling; }
+    void setIdleLoopSkip(bool enabled) { idleLoopSkip = enabled; }
     void printState();
 
     bool checkInterupt();
+    void setInterruptRegisters(u8 enable, u8 flags) { pendingInterrupts = enable & flags & 0x1F; }
+
+#if CPU_PROFILE_OPCODES
+    void dumpOpcodeProfile(const std::string& path);
+#endif
+
+    // Echo RAM (0xE000-0xFDFF) is the memory at 0xC000-0xDDFF, code run from
+    // either address is tracked on the line of the lower one
+    static u32 codeLine(u16 addr) { return ((0xE000 <= addr && addr <= 0xFDFF) ? addr - 0x2000 : addr) >> 4; }
+    bool isCode(u16 addr) { return addr >= 0x8000 && codeLines[codeLine(addr) - 0x800]; }
+    void invalidateCode(u16 addr);
+    void resetFetchWindow() { fetchSize = 0; } // after a bank switch
 };
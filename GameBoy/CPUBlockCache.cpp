@@ -0,0 +1,175 @@
+#include <string>
+#include <iostream>
+
+#include "CPU.h"
+#include "definitions.h"
+#include "Bus.h"
+
+using namespace std;
+
+// Pre-decoded basic blocks for CPUEngine::BlockCache. A block is a straight
+// run of instructions starting at a given PC, decoded once into DecodedOps and
+// ending at the first instruction that can change control flow or interrupt
+// state. Blocks are keyed by (ROM bank, PC), so code in the switchable bank is
+// decoded separately for every bank it is run from. Code in RAM is tracked in
+// 16-byte lines and the blocks covering a line are dropped when it is written,
+// or, for cartridge RAM, when the bus maps another bank.
+// Lookups go through a small direct-mapped table of recent blocks first, the
+// frame loop's short slices re-enter runCached every few instructions.
+
+const int MAX_BLOCK_LENGTH = 32;
+
+static const u8 opcodeLength[256] = {
+	1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1,
+	1, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+	2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+	2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,
+	1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,
+	2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+	2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+};
+
+// 0: ROM bank 0, 1: switchable ROM bank, 2: RAM and I/O
+int region(u16 addr) { return (addr < 0x4000) ? 0 : (addr < 0x8000) ? 1 : 2; }
+
+bool endsBlock(u8 opcode) {
+	switch (opcode) {
+	case 0x10: case 0x76: case 0xF3: case 0xFB: // STOP, HALT, DI, EI
+	case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+	case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: case 0xE9: // JP
+	case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC: // CALL
+	case 0xC0: case 0xC8: case 0xC9: case 0xD0: case 0xD8: case 0xD9: // RET, RETI
+	case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST
+	case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB: case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD: // invalid
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool isIORegister(u16 addr) { return 0xFF00 <= addr && addr <= 0xFF7F; }
+
+// A loop that loads A from an I/O register, tests it and branches back to its
+// own start, e.g. LDH A, (44); CP 90; JR NZ. It writes nothing and reads have
+// no side effects, so every pass after the first leaves the CPU exactly as it
+// was until an interrupt or the PPU changes what it reads. Loads from RAM, or
+// through a register whose value isn't known here, don't qualify.
+
+bool isIdleLoop(const Block& block) {
+	const DecodedOp& last = block.ops.back();
+	u16 target;
+	switch (last.opcode) {
+	case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+		target = block.end + (s8)last.operand;
+		break;
+	case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: // JP a16
+		target = last.operand;
+		break;
+	default:
+		return false;
+	}
+	if (target != block.start) return false;
+
+	bool loaded = false; // A has been reloaded from memory in this pass
+	for (size_t i = 0; i + 1 < block.ops.size(); i++) {
+		const DecodedOp& op = block.ops[i];
+		switch (op.opcode) {
+		case 0xF0: // LDH A, (a8)
+			if (!isIORegister(0xFF00 + (u8)op.operand)) return false;
+			loaded = true;
+			break;
+		case 0xFA: // LD A, (a16)
+			if (!isIORegister(op.operand)) return false;
+			loaded = true;
+			break;
+		case 0xA7: case 0xB7: case 0xE6: case 0xF6: case 0xFE: // AND A, OR A, AND/OR/CP d8
+			if (!loaded) return false;
+			break;
+		case 0xCB:
+			if ((op.operand & 0xC7) == 0x47 && loaded) break; // BIT n, A
+			return false;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+u32 CPU::blockKey(u16 addr) {
+	// Keyed by the ROM bank mapped at addr, code in RAM by address only
+	u32 bank = (addr <= 0x7FFF) ? bus->getRomBank(addr) : 0;
+	return (bank << 16) | addr;
+}
+
+Block& CPU::getBlock(u16 addr) {
+	u32 key = blockKey(addr);
+	BlockSlot& slot = recentBlocks[addr & (RECENT_BLOCKS - 1)];
+	if (slot.block != nullptr && slot.key == key) return *slot.block;
+	auto it = blocks.find(key);
+	if (it != blocks.end()) {
+		slot = { key, &it->second };
+		return it->second;
+	}
+
+	Block& block = blocks[key];
+	slot = { key, &block };
+	block.start = addr;
+	u16 pc = addr;
+	for (int i = 0; i < MAX_BLOCK_LENGTH; i++) {
+		DecodedOp op;
+		op.opcode = bus->read(pc);
+		op.length = opcodeLength[op.opcode];
+		if (op.length == 2) op.operand = bus->read(pc + 1);
+		else if (op.length == 3) op.operand = bus->read(pc + 2) << 8 | bus->read(pc + 1);
+		else op.operand = 0;
+		block.ops.push_back(op);
+		pc += op.length;
+
+		// Keep blocks within one region so the bank in the key stays valid
+		if (endsBlock(op.opcode) || region(pc) != region(addr)) break;
+	}
+	block.end = pc;
+	fuseBlock(block);
+	block.idleLoop = isIdleLoop(block);
+
+	if (addr >= 0x8000) {
+		for (u32 line = addr >> 4; line <= (u32)((block.end - 1) & 0xFFFF) >> 4; line++) {
+			codeLines[codeLine(line << 4) - 0x800] = true;
+		}
+	}
+	return block;
+}
+
+void CPU::invalidateCode(u16 addr) {
+	staleLines[codeLine(addr) - 0x800] = true;
+	codeLines[codeLine(addr) - 0x800] = false;
+	codeDirty = true;
+}
+
+void CPU::purgeStaleBlocks() {
+	for (auto it = blocks.begin(); it != blocks.end();) {
+		const Block& block = it->second;
+		bool stale = false;
+		if (block.start >= 0x8000) {
+			for (u32 line = block.start >> 4; line <= (u32)((block.end - 1) & 0xFFFF) >> 4; line++) {
+				if (staleLines[codeLine(line << 4) - 0x800]) {
+					stale = true;
+					break;
+				}
+			}
+		}
+		it = stale ? blocks.erase(it) : next(it);
+	}
+	staleLines.reset();
+	codeDirty = false;
+	for (auto& slot : recentBlocks) slot.block = nullptr;
+}
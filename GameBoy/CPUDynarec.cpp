@@ -0,0 +1,539 @@
+#include <string>
+#include <iostream>
+#include <cstring>
+
+#include "CPU.h"
+#include "definitions.h"
+#include "Bus.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CPU_DYNAREC 1
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#else
+#define CPU_DYNAREC 0
+#endif
+
+using namespace std;
+
+// x86-64 dynamic recompiler for CPUEngine::Dynarec. Blocks from the block cache
+// that have run JIT_THRESHOLD times are translated into host code in an
+// executable arena. Register loads, 8-bit ALU ops, INC/DEC, reads through
+// (HL), (BC) and (DE), and JR/JP are emitted natively; ALU ops write the same
+// lazy flag record as the interpreter's helpers. Every other instruction
+// becomes a call into executeDecoded.
+//
+// Translated code keeps cycleCount in a register and compares it with the
+// deadline after each instruction, leaving through a stub that stores PC, so
+// it stops on the same instruction as the interpreter. A block that branches
+// back to its own start loops natively until the deadline. It also leaves
+// after any called instruction that makes an interrupt due or writes to cached
+// code. Blocks end at EI, DI and HALT; while an EI is waiting to take effect
+// the interpreter runs instead. The arena is writable or executable, never
+// both: it is switched to read/execute after each translation.
+//
+// Blocks that access I/O registers (0xFF00-0xFF7F) through LDH, LD (C) or an
+// absolute address are never compiled and keep running in the interpreter.
+// Other targets, or hosts without x86-64, always use the interpreter.
+
+const u32 JIT_THRESHOLD = 16;
+const size_t JIT_ARENA_SIZE = 4 << 20;
+const size_t JIT_MAX_BLOCK_SIZE = 8192; // MAX_BLOCK_LENGTH ops of at most ~200 bytes
+
+// Returns nonzero if the block ran to its end
+typedef int (*JitBlock)(CPU* cpu, u64 cycleDeadline);
+
+// Base cycles of each opcode, taken branches add one
+static const u8 baseCycles[0x100] = {
+#define OPCODE(code, cycles, name, body) cycles,
+#include "CPUOpcodes.inl"
+#undef OPCODE
+};
+
+bool touchesIO(const DecodedOp& op) {
+	switch (op.opcode) {
+	case 0xE0: case 0xF0: // LDH (a8)
+	case 0xE2: case 0xF2: // LD (C)
+		return true;
+	case 0xEA: case 0xFA: // LD (a16)
+		return 0xFF00 <= op.operand && op.operand <= 0xFF7F;
+	default:
+		return false;
+	}
+}
+
+#if CPU_DYNAREC
+
+bool protectJitArena(u8* arena, bool writable) {
+#ifdef _WIN32
+	DWORD old;
+	if (!VirtualProtect(arena, JIT_ARENA_SIZE, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old)) return false;
+	if (!writable) FlushInstructionCache(GetCurrentProcess(), arena, JIT_ARENA_SIZE);
+	return true;
+#else
+	return mprotect(arena, JIT_ARENA_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+// Host registers: rbx holds the CPU*, r12 cycleCount, r13 the deadline and r14
+// the bus's read page table. eax, ecx and edx are scratch, r15d keeps a value
+// read from memory across a call.
+struct Emitter {
+	u8* p;
+
+	enum Reg : u8 { EAX, ECX, EDX };
+	enum Cond : u8 { JB = 0x82, JAE = 0x83, JE = 0x84, JNE = 0x85 };
+
+	void byte(u8 b) { *p++ = b; }
+	void bytes(initializer_list<u8> list) { for (u8 b : list) *p++ = b; }
+	void word(u16 w) { memcpy(p, &w, 2); p += 2; }
+	void dword(u32 d) { memcpy(p, &d, 4); p += 4; }
+	void qword(u64 q) { memcpy(p, &q, 8); p += 8; }
+
+	// All CPU fields are addressed as [rbx + disp32]
+	void field(u8 reg, s32 disp) { byte(0x83 | reg << 3); dword(disp); }
+	void loadByte(Reg r, s32 src) { bytes({ 0x0F, 0xB6 }); field(r, src); }        // movzx r, byte [rbx+src]
+	void loadWord(Reg r, s32 src) { bytes({ 0x0F, 0xB7 }); field(r, src); }        // movzx r, word [rbx+src]
+	void storeByte(Reg r, s32 dst) { byte(0x88); field(r, dst); }                  // mov [rbx+dst], r8
+	void storeWord(Reg r, s32 dst) { bytes({ 0x66, 0x89 }); field(r, dst); }       // mov [rbx+dst], r16
+	void storeImm8(s32 dst, u8 v) { byte(0xC6); field(0, dst); byte(v); }          // mov byte [rbx+dst], v
+	void storeImm16(s32 dst, u16 v) { bytes({ 0x66, 0xC7 }); field(0, dst); word(v); }
+	void incWord(s32 dst) { bytes({ 0x66, 0xFF }); field(0, dst); }               // inc word [rbx+dst]
+	void decWord(s32 dst) { bytes({ 0x66, 0xFF }); field(1, dst); }               // dec word [rbx+dst]
+	void cmpByteZero(s32 dst) { byte(0x80); field(7, dst); byte(0x00); }          // cmp byte [rbx+dst], 0
+
+	void addCycles(u32 n) { bytes({ 0x49, 0x81, 0xC4 }); dword(n); }             // add r12, n
+	void cmpDeadline() { bytes({ 0x4D, 0x39, 0xEC }); }                           // cmp r12, r13
+	void saveCycles(s32 dst) { bytes({ 0x4C, 0x89, 0xA3 }); dword(dst); }         // mov [rbx+dst], r12
+	void loadCycles(s32 src) { bytes({ 0x4C, 0x8B, 0xA3 }); dword(src); }         // mov r12, [rbx+src]
+
+	u8* jump(Cond cond) { bytes({ 0x0F, cond }); dword(0); return p - 4; }        // jcc rel32, patched later
+	u8* jump() { byte(0xE9); dword(0); return p - 4; }                           // jmp rel32, patched later
+	static void patch(u8* fixup, u8* target) {
+		s32 rel = (s32)(target - (fixup + 4));
+		memcpy(fixup, &rel, 4);
+	}
+
+	void prologue(const u8* const* readPages) {
+		bytes({ 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57 }); // push rbx, r12-r15
+#ifdef _WIN32
+		bytes({ 0x48, 0x89, 0xCB });                         // mov rbx, rcx
+		bytes({ 0x49, 0x89, 0xD5 });                         // mov r13, rdx
+		bytes({ 0x48, 0x83, 0xEC, 0x20 });                   // sub rsp, 32 (shadow space)
+#else
+		bytes({ 0x48, 0x89, 0xFB });                         // mov rbx, rdi
+		bytes({ 0x49, 0x89, 0xF5 });                         // mov r13, rsi
+#endif
+		bytes({ 0x49, 0xBE }); qword((u64)readPages);        // mov r14, readPages
+	}
+
+	void epilogue() {
+#ifdef _WIN32
+		bytes({ 0x48, 0x83, 0xC4, 0x20 });                   // add rsp, 32
+#endif
+		bytes({ 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B }); // pop r15-r12, rbx
+		byte(0xC3);                                          // ret
+	}
+
+	// fn(cpu), fn(cpu, arg) or fn(cpu, eax)
+	void call(void* fn) {
+#ifdef _WIN32
+		bytes({ 0x48, 0x89, 0xD9 });                         // mov rcx, rbx
+#else
+		bytes({ 0x48, 0x89, 0xDF });                         // mov rdi, rbx
+#endif
+		bytes({ 0x48, 0xB8 }); qword((u64)fn);               // mov rax, fn
+		bytes({ 0xFF, 0xD0 });                               // call rax
+	}
+	void call(void* fn, u32 arg) {
+#ifdef _WIN32
+		byte(0xBA); dword(arg);                              // mov edx, arg
+#else
+		byte(0xBE); dword(arg);                              // mov esi, arg
+#endif
+		call(fn);
+	}
+	void callWithEax(void* fn) {
+#ifdef _WIN32
+		bytes({ 0x89, 0xC2 });                               // mov edx, eax
+#else
+		bytes({ 0x89, 0xC6 });                               // mov esi, eax
+#endif
+		call(fn);
+	}
+
+	// eax = bus->read(ax) through the page table, unmapped pages call slowRead
+	void read(s32 cycleCount, void* slowRead) {
+		bytes({ 0x89, 0xC1 });                               // mov ecx, eax
+		bytes({ 0xC1, 0xE9, 0x08 });                         // shr ecx, 8
+		bytes({ 0x49, 0x8B, 0x0C, 0xCE });                   // mov rcx, [r14 + rcx*8]
+		bytes({ 0x48, 0x85, 0xC9 });                         // test rcx, rcx
+		u8* slow = jump(JE);
+		bytes({ 0x0F, 0xB6, 0xC0 });                         // movzx eax, al
+		bytes({ 0x0F, 0xB6, 0x04, 0x01 });                   // movzx eax, byte [rcx + rax]
+		u8* done = jump();
+		patch(slow, p);
+		saveCycles(cycleCount); // the bus may end an OAM DMA
+		callWithEax(slowRead);
+		bytes({ 0x0F, 0xB6, 0xC0 });                         // movzx eax, al
+		patch(done, p);
+	}
+};
+
+void CPU::jitStep(CPU* cpu, u32 packed) {
+	DecodedOp op;
+	op.opcode = packed & 0xFF;
+	op.length = (packed >> 8) & 0xFF;
+	op.operand = packed >> 16;
+	cpu->cycleCount += cpu->executeDecoded(op);
+	cpu->jitExit = cpu->codeDirty || (cpu->pendingInterrupts != 0 && cpu->interuptsEnabled);
+}
+
+u8 CPU::jitRead(CPU* cpu, u16 addr) {
+	return cpu->bus->read(addr);
+}
+
+u8 CPU::jitFlags(CPU* cpu) {
+	cpu->flushFlags();
+	return cpu->AF.low;
+}
+
+// Host address of the field an 8-bit register index refers to (as in readR8)
+u8* CPU::jitRegister(u8 index) {
+	switch (index) {
+	case 0: return &BC.high;
+	case 1: return &BC.low;
+	case 2: return &DE.high;
+	case 3: return &DE.low;
+	case 4: return &HL.high;
+	case 5: return &HL.low;
+	case 7: return &AF.high;
+	default: return nullptr;
+	}
+}
+
+void CPU::compileBlock(Block& block) {
+#if CPU_PROFILE_OPCODES
+	// Native instructions would not be counted
+	block.interpretOnly = true;
+	return;
+#endif
+	for (auto& op : block.ops) {
+		if (touchesIO(op)) {
+			block.interpretOnly = true;
+			return;
+		}
+	}
+
+	if (jitArena == nullptr) {
+#ifdef _WIN32
+		jitArena = (u8*)VirtualAlloc(nullptr, JIT_ARENA_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+		void* mem = mmap(nullptr, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		jitArena = (mem == MAP_FAILED) ? nullptr : (u8*)mem;
+#endif
+		if (jitArena == nullptr) {
+			block.interpretOnly = true;
+			return;
+		}
+	}
+	else if (!protectJitArena(jitArena, true)) {
+		block.interpretOnly = true;
+		return;
+	}
+	if (jitUsed + JIT_MAX_BLOCK_SIZE > JIT_ARENA_SIZE) {
+		// Arena is full, drop every translation and start again
+		for (auto& entry : blocks) entry.second.code = nullptr;
+		jitUsed = 0;
+	}
+
+	typedef Emitter E;
+	auto offset = [this](void* field) { return (s32)((u8*)field - (u8*)this); };
+	s32 cycles = offset(&cycleCount);
+	s32 lazyOp = offset(&lazy.op);
+	s32 lazyA = offset(&lazy.a);
+	s32 lazyB = offset(&lazy.b);
+	s32 lazyCarry = offset(&lazy.carry);
+	s32 regA = offset(&AF.high);
+	Emitter e{ jitArena + jitUsed };
+	vector<u8*> exits;            // to the epilogue, cycleCount and PC already stored
+	vector<pair<u8*, u16>> stubs; // stopped before the end of the block, with the PC to resume at
+
+	// What the last native ALU op left in the lazy record. Unknown at the start
+	// of the block and after a called instruction.
+	bool flagsKnown = false;
+	FlagOp flags = FlagOp::None;
+
+	// Z or C into dl (0 or 1)
+	auto flag = [&](FLAGS f) {
+		if (!flagsKnown) {
+			e.call((void*)&CPU::jitFlags);
+			e.bytes({ 0x88, 0xC2 });                         // mov dl, al
+			flagsKnown = true;
+			flags = FlagOp::None;
+		}
+		else if (flags == FlagOp::None) {
+			e.loadByte(E::EDX, offset(&AF.low));
+		}
+		switch (flags) {
+		case FlagOp::None:
+			if (f == Z) e.bytes({ 0xC0, 0xEA, 0x07 });       // shr dl, 7
+			else e.bytes({ 0xC0, 0xEA, 0x04, 0x80, 0xE2, 0x01 }); // shr dl, 4; and dl, 1
+			break;
+		case FlagOp::Add:
+		case FlagOp::Sub: {
+			bool add = flags == FlagOp::Add;
+			e.loadByte(E::EAX, lazyA);
+			e.loadByte(E::ECX, lazyB);
+			e.bytes({ (u8)(add ? 0x01 : 0x29), 0xC8 });      // add/sub eax, ecx
+			e.loadByte(E::ECX, lazyCarry);
+			e.bytes({ (u8)(add ? 0x01 : 0x29), 0xC8 });
+			if (f == Z) e.bytes({ 0x84, 0xC0, 0x0F, 0x94, 0xC2 }); // test al, al; sete dl
+			else if (add) { e.byte(0x3D); e.dword(0xFF); e.bytes({ 0x0F, 0x97, 0xC2 }); } // cmp eax, 0xFF; seta dl
+			else e.bytes({ 0x0F, 0x9C, 0xC2 });              // setl dl
+			break;
+		}
+		case FlagOp::And:
+		case FlagOp::Or:
+			if (f == Z) { e.cmpByteZero(lazyA); e.bytes({ 0x0F, 0x94, 0xC2 }); }
+			else e.bytes({ 0x31, 0xD2 });                    // xor edx, edx
+			break;
+		case FlagOp::Inc:
+		case FlagOp::Dec:
+			if (f == Z) {
+				e.loadByte(E::EAX, lazyA);
+				e.bytes({ 0xFE, (u8)(flags == FlagOp::Inc ? 0xC0 : 0xC8) }); // inc/dec al
+				e.bytes({ 0x0F, 0x94, 0xC2 });
+			}
+			else e.loadByte(E::EDX, lazyCarry);
+			break;
+		}
+	};
+
+	auto complete = [&]() {
+		e.bytes({ 0xB8, 0x01, 0x00, 0x00, 0x00 });           // mov eax, 1
+		exits.push_back(e.jump());
+	};
+	u8* top = nullptr;
+	// Taken or not, a branch ends the block. Idle loops go back to runCached,
+	// which skips their passes.
+	auto branchTo = [&](u16 target) {
+		if (target == block.start && !block.idleLoop) {
+			e.cmpDeadline();
+			Emitter::patch(e.jump(E::JB), top);
+		}
+		e.storeImm16(offset(&PC.value), target);
+		complete();
+	};
+
+	e.prologue(bus->readPageTable());
+	e.loadCycles(cycles);
+	top = e.p;
+	u16 pc = block.start;
+	for (size_t i = 0; i < block.ops.size(); i++) {
+		const DecodedOp& op = block.ops[i];
+		bool last = i + 1 == block.ops.size();
+		u8 code = op.opcode;
+		pc += op.length;
+		u8* dst = jitRegister((code >> 3) & 0x7);
+		u8* src = jitRegister(code & 0x7);
+		Register* pair = (code >> 4) == 0 ? &BC : (code >> 4) == 1 ? &DE : (code >> 4) == 2 ? &HL : &SP;
+		bool alu = (0x80 <= code && code <= 0xBF) || (code >= 0xC0 && (code & 0xC7) == 0xC6);
+		bool native = true;
+
+		if (code == 0x00) { // NOP
+		}
+		else if (0x40 <= code && code <= 0x7F && dst && src) { // LD r, r
+			e.loadByte(E::EAX, offset(src));
+			e.storeByte(E::EAX, offset(dst));
+		}
+		else if (0x40 <= code && code <= 0x7F && dst && (code & 0x7) == 0x6) { // LD r, (HL)
+			e.loadWord(E::EAX, offset(&HL.value));
+			e.read(cycles, (void*)&CPU::jitRead);
+			e.storeByte(E::EAX, offset(dst));
+		}
+		else if (code == 0x0A || code == 0x1A || code == 0x2A || code == 0x3A) { // LD A, (BC) (DE) (HL+) (HL-)
+			Register* addr = code == 0x0A ? &BC : code == 0x1A ? &DE : &HL;
+			e.loadWord(E::EAX, offset(&addr->value));
+			e.read(cycles, (void*)&CPU::jitRead);
+			e.storeByte(E::EAX, regA);
+			if (code == 0x2A) e.incWord(offset(&HL.value));
+			if (code == 0x3A) e.decWord(offset(&HL.value));
+		}
+		else if (code < 0x40 && (code & 0x7) == 0x6 && dst) { // LD r, d8
+			e.storeImm8(offset(dst), (u8)op.operand);
+		}
+		else if (code < 0x40 && (code & 0xF) == 0x1) { // LD rr, d16
+			e.storeImm16(offset(&pair->value), op.operand);
+		}
+		else if (code < 0x40 && (code & 0xF) == 0x3) { // INC rr
+			e.incWord(offset(&pair->value));
+		}
+		else if (code < 0x40 && (code & 0xF) == 0xB) { // DEC rr
+			e.decWord(offset(&pair->value));
+		}
+		else if (code == 0xF9) { // LD SP, HL
+			e.loadWord(E::EAX, offset(&HL.value));
+			e.storeWord(E::EAX, offset(&SP.value));
+		}
+		else if (CPU_LAZY_FLAGS && code < 0x40 && ((code & 0x7) == 0x4 || (code & 0x7) == 0x5) && dst) { // INC r, DEC r
+			bool inc = (code & 0x7) == 0x4;
+			flag(C);
+			e.loadByte(E::EAX, offset(dst));
+			e.storeByte(E::EAX, lazyA);
+			e.storeImm8(lazyB, 0);
+			e.storeByte(E::EDX, lazyCarry);
+			flags = inc ? FlagOp::Inc : FlagOp::Dec;
+			e.storeImm8(lazyOp, (u8)flags);
+			flagsKnown = true;
+			e.bytes({ 0xFE, (u8)(inc ? 0xC0 : 0xC8) });      // inc/dec al
+			e.storeByte(E::EAX, offset(dst));
+		}
+		else if (CPU_LAZY_FLAGS && alu) { // ADD, ADC, SUB, SBC, AND, XOR, OR, CP with r, (HL) or d8
+			u8 kind = (code >> 3) & 0x7;
+			bool immediate = code >= 0xC0;
+			bool memory = !immediate && !src;
+			bool withCarry = kind == 1 || kind == 3;
+			if (memory) {
+				e.loadWord(E::EAX, offset(&HL.value));
+				e.read(cycles, (void*)&CPU::jitRead);
+				e.bytes({ 0x41, 0x89, 0xC7 });               // mov r15d, eax
+			}
+			if (withCarry) flag(C);
+			if (immediate) { e.byte(0xB9); e.dword((u8)op.operand); } // mov ecx, d8
+			else if (memory) e.bytes({ 0x44, 0x89, 0xF9 });  // mov ecx, r15d
+			else e.loadByte(E::ECX, offset(src));
+			e.loadByte(E::EAX, regA);
+			if (kind < 4 || kind == 7) {
+				e.storeByte(E::EAX, lazyA);
+				e.storeByte(E::ECX, lazyB);
+				if (withCarry) e.storeByte(E::EDX, lazyCarry);
+				else e.storeImm8(lazyCarry, 0);
+				flags = kind < 2 ? FlagOp::Add : FlagOp::Sub;
+				e.storeImm8(lazyOp, (u8)flags);
+				if (kind != 7) {
+					bool add = kind < 2;
+					e.bytes({ (u8)(add ? 0x00 : 0x28), 0xC8 });  // add/sub al, cl
+					if (withCarry) e.bytes({ (u8)(add ? 0x00 : 0x28), 0xD0 }); // add/sub al, dl
+					e.storeByte(E::EAX, regA);
+				}
+			}
+			else {
+				e.bytes({ (u8)(kind == 4 ? 0x20 : kind == 5 ? 0x30 : 0x08), 0xC8 }); // and/xor/or al, cl
+				e.storeByte(E::EAX, regA);
+				e.storeByte(E::EAX, lazyA);
+				e.storeImm8(lazyB, 0);
+				e.storeImm8(lazyCarry, 0);
+				flags = kind == 4 ? FlagOp::And : FlagOp::Or;
+				e.storeImm8(lazyOp, (u8)flags);
+			}
+			flagsKnown = true;
+		}
+		else if (code == 0x18 || code == 0xC3) { // JR s8, JP a16
+			u16 target = code == 0x18 ? (u16)(pc + (s8)op.operand) : op.operand;
+			e.addCycles(baseCycles[code] + 1);
+			branchTo(target);
+			continue;
+		}
+		else if (CPU_LAZY_FLAGS && ((code & 0xE7) == 0x20 || (code & 0xE7) == 0xC2)) { // JR cc, JP cc
+			u16 target = code < 0x40 ? (u16)(pc + (s8)op.operand) : op.operand;
+			u8 cc = (code >> 3) & 0x3; // NZ, Z, NC, C
+			flag(cc < 2 ? Z : C);
+			e.bytes({ 0x84, 0xD2 });                         // test dl, dl
+			u8* notTaken = e.jump((cc & 1) ? E::JE : E::JNE);
+			e.addCycles(baseCycles[code] + 1);
+			branchTo(target);
+			Emitter::patch(notTaken, e.p);
+			e.addCycles(baseCycles[code]);
+			branchTo(pc);
+			continue;
+		}
+		else {
+			native = false;
+			e.saveCycles(cycles);
+			e.storeImm16(offset(&PC.value), pc);
+			e.call((void*)&CPU::jitStep, op.opcode | op.length << 8 | (u32)op.operand << 16);
+			e.loadCycles(cycles);
+			flagsKnown = false;
+		}
+
+		if (last) {
+			if (native) {
+				e.addCycles(baseCycles[code]);
+				e.storeImm16(offset(&PC.value), pc);
+			}
+			complete();
+			break;
+		}
+		if (native) {
+			e.addCycles(baseCycles[code]);
+		}
+		else {
+			// Stop if the instruction wrote to cached code or made an interrupt due
+			e.cmpByteZero(offset(&jitExit));
+			stubs.push_back({ e.jump(E::JNE), pc });
+		}
+		e.cmpDeadline();
+		stubs.push_back({ e.jump(E::JAE), pc });
+	}
+
+	u8* exit = e.p;
+	e.saveCycles(cycles);
+	e.epilogue();
+	for (u8* fixup : exits) Emitter::patch(fixup, exit);
+	for (auto& stub : stubs) {
+		Emitter::patch(stub.first, e.p);
+		e.storeImm16(offset(&PC.value), stub.second);
+		e.bytes({ 0x31, 0xC0 });                             // xor eax, eax
+		Emitter::patch(e.jump(), exit);
+	}
+
+	u8* code = jitArena + jitUsed;
+	jitUsed = e.p - jitArena;
+	if (!protectJitArena(jitArena, false)) {
+		// Nothing in the arena can run any more
+		freeJitArena();
+		for (auto& entry : blocks) entry.second.code = nullptr;
+		jitUsed = 0;
+		block.interpretOnly = true;
+		return;
+	}
+	block.code = code;
+}
+
+void CPU::freeJitArena() {
+	if (jitArena == nullptr) return;
+#ifdef _WIN32
+	VirtualFree(jitArena, 0, MEM_RELEASE);
+#else
+	munmap(jitArena, JIT_ARENA_SIZE);
+#endif
+	jitArena = nullptr;
+}
+
+#else
+
+void CPU::compileBlock(Block& block) { block.interpretOnly = true; }
+void CPU::freeJitArena() {}
+
+#endif
+
+// Runs the block natively if it is (or has just become) hot enough to be
+// translated. Returns false if the interpreter should run it instead, else
+// sets `completed` if the block ran to its end rather than stopping at the
+// deadline or after an instruction that needs runCached to look at it.
+bool CPU::runNative(Block& block, u64 cycleDeadline, bool& completed) {
+	// Native code does not count down imeDelay
+	if (imeDelay != 0) return false;
+	if (block.code == nullptr) {
+		if (block.interpretOnly || ++block.hits < JIT_THRESHOLD) return false;
+		compileBlock(block);
+		if (block.code == nullptr) return false;
+	}
+	jitExit = false;
+	completed = ((JitBlock)block.code)(this, cycleDeadline) != 0;
+	return true;
+}
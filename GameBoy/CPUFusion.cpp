@@ -0,0 +1,134 @@
+#include <string>
+#include <iostream>
+
+#include "CPU.h"
+#include "definitions.h"
+#include "Bus.h"
+
+using namespace std;
+
+// Superinstructions for the block cache. The sequences below were picked from
+// opcode pair/triple counts of Tetris and Dr. Mario: delay loops (DEC r;
+// JR NZ), LY/STAT/joypad polls (LDH A,(n); AND/CP; JR) and memcpy loops
+// (LD A,(HL+); LD (DE),A and LD A,B; OR C; JR NZ). A fused handler runs the
+// whole sequence with the combined cycle count and no interrupt check in
+// between. Sequences never continue past a memory write, so a write to cached
+// code, IE or IF is still seen before the next decoded op runs. Nothing else
+// can make an interrupt due within a sequence, so the interpreter only has to
+// avoid fused ops while an EI is taking effect or the deadline is in reach
+// (canRunFused).
+
+const u64 FUSED_MAX_CYCLES = 8; // LDH A,(n); CP n; JR taken
+
+bool isDecR8(u8 opcode) { return (opcode & 0xC7) == 0x05 && opcode != 0x35; }
+bool isLdhTest(u8 opcode) { return opcode == 0xA7 || opcode == 0xE6 || opcode == 0xFE; }
+
+void CPU::fuseBlock(Block& block) {
+	auto& ops = block.ops;
+	for (size_t i = 0; i < ops.size(); i++) {
+		size_t left = ops.size() - i;
+		u8 a = ops[i].opcode;
+		u8 b = left > 1 ? ops[i + 1].opcode : 0;
+		u8 c = left > 2 ? ops[i + 2].opcode : 0;
+
+		if (left > 1 && isDecR8(a) && b == 0x20) {
+			ops[i].fused = FusedOp::DecJrNz;
+			ops[i].span = 2;
+		}
+		else if (left > 2 && a == 0xF0 && isLdhTest(b) && (c == 0x20 || c == 0x28)) {
+			ops[i].fused = FusedOp::LdhTestJr;
+			ops[i].span = 3;
+		}
+		else if (left > 1 && a == 0xF0 && isLdhTest(b)) {
+			ops[i].fused = FusedOp::LdhTest;
+			ops[i].span = 2;
+		}
+		else if (left > 1 && a == 0x2A && b == 0x12) {
+			ops[i].fused = FusedOp::CopyHLI;
+			ops[i].span = 2;
+		}
+		else if (left > 2 && a == 0x78 && b == 0xB1 && c == 0x20) {
+			ops[i].fused = FusedOp::TestBCJrNz;
+			ops[i].span = 3;
+		}
+		i += ops[i].span - 1;
+	}
+}
+
+// A fused op is only equivalent to its parts if the interpreter would not
+// have stopped or taken an interrupt between them
+bool CPU::canRunFused(u64 cycleDeadline) const {
+	return imeDelay == 0 && cycleDeadline - cycleCount > FUSED_MAX_CYCLES;
+}
+
+// Runs ops[0] .. ops[span - 1] as one instruction. Flags end up as they would
+// after running them one by one.
+int CPU::executeFused(const DecodedOp* ops) {
+	const DecodedOp& head = ops[0];
+	for (int i = 0; i < head.span; i++) PC.value += ops[i].length;
+
+	int cycles = 0;
+	switch (head.fused) {
+	case FusedOp::DecJrNz: {
+		u8 index = (head.opcode >> 3) & 0x7;
+		u8 val = dec8(readR8(index));
+		writeR8(index, val);
+		cycles = 1 + 2;
+		if (val != 0) {
+			PC.value += (s8)ops[1].operand;
+			cycles += 1;
+		}
+		profileOpcode(head.opcode, 1);
+		profileOpcode(0x20, cycles - 1);
+		break;
+	}
+	case FusedOp::LdhTest:
+	case FusedOp::LdhTestJr: {
+		AF.high = bus->read(head.operand + 0xFF00);
+		cycles = 3;
+		bool zero;
+		switch (ops[1].opcode) {
+		case 0xA7: and8(AF.high); zero = AF.high == 0; cycles += 1; break;
+		case 0xE6: and8(ops[1].operand); zero = AF.high == 0; cycles += 2; break;
+		default: cp8(ops[1].operand); zero = AF.high == (u8)ops[1].operand; cycles += 2; break;
+		}
+		profileOpcode(0xF0, 3);
+		profileOpcode(ops[1].opcode, cycles - 3);
+		if (head.fused == FusedOp::LdhTestJr) {
+			int jr = 2;
+			if (zero == (ops[2].opcode == 0x28)) {
+				PC.value += (s8)ops[2].operand;
+				jr += 1;
+			}
+			profileOpcode(ops[2].opcode, jr);
+			cycles += jr;
+		}
+		break;
+	}
+	case FusedOp::CopyHLI:
+		AF.high = bus->read(HL.value++);
+		bus->write(DE.value, AF.high);
+		cycles = 2 + 2;
+		profileOpcode(0x2A, 2);
+		profileOpcode(0x12, 2);
+		break;
+	case FusedOp::TestBCJrNz:
+		AF.high = BC.high;
+		or8(BC.low);
+		cycles = 1 + 1 + 2;
+		if (AF.high != 0) {
+			PC.value += (s8)ops[2].operand;
+			cycles += 1;
+		}
+		profileOpcode(0x78, 1);
+		profileOpcode(0xB1, 1);
+		profileOpcode(0x20, cycles - 2);
+		break;
+	default:
+		break;
+	}
+#if CPU_PROFILE_OPCODES
+	fusedCounts[(int)head.fused]++;
+#endif
+	return cycles;
+}
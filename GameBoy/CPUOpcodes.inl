@@ -0,0 +1,265 @@
+// SM83 base opcode table shared by the switch-dispatched engines.
+//
+// Each entry is OPCODE(opcode, cycles, name, body). `cycles` matches the
+// lookup table built in CPU::CPU(); bodies add any extra cycles for taken
+// branches to `cycles`. The including file defines OPCODE, and IMM8/IMM16 for
+// reading the instruction's immediate operand, before including this file.
+// 0xCB is listed as invalid here, the prefix is decoded by the caller and
+// dispatched to CPU::executeCB.
+
+OPCODE(0x00, 1, "NOP", {})
+OPCODE(0x01, 3, "LD BC, d16", { BC.value = IMM16(); })
+OPCODE(0x02, 2, "LD (BC), A", { bus->write(BC.value, AF.high); })
+OPCODE(0x03, 2, "INC BC", { BC.value++; })
+OPCODE(0x04, 1, "INC B", { BC.high = inc8(BC.high); })
+OPCODE(0x05, 1, "DEC B", { BC.high = dec8(BC.high); })
+OPCODE(0x06, 2, "LD B, d8", { BC.high = IMM8(); })
+OPCODE(0x07, 1, "RLCA", { AF.high = rlc8(AF.high); setFlag(Z, false); })
+OPCODE(0x08, 5, "LD (a16), SP", { u16 addr = IMM16(); bus->write(addr, SP.low); bus->write(addr + 1, SP.high); })
+OPCODE(0x09, 2, "ADD HL, BC", { addHL(BC.value); })
+OPCODE(0x0A, 2, "LD A, (BC)", { AF.high = bus->read(BC.value); })
+OPCODE(0x0B, 2, "DEC BC", { BC.value--; })
+OPCODE(0x0C, 1, "INC C", { BC.low = inc8(BC.low); })
+OPCODE(0x0D, 1, "DEC C", { BC.low = dec8(BC.low); })
+OPCODE(0x0E, 2, "LD C, d8", { BC.low = IMM8(); })
+OPCODE(0x0F, 1, "RRCA", { AF.high = rrc8(AF.high); setFlag(Z, false); })
+OPCODE(0x10, 1, "STOP", {})
+OPCODE(0x11, 3, "LD DE, d16", { DE.value = IMM16(); })
+OPCODE(0x12, 2, "LD (DE), A", { bus->write(DE.value, AF.high); })
+OPCODE(0x13, 2, "INC DE", { DE.value++; })
+OPCODE(0x14, 1, "INC D", { DE.high = inc8(DE.high); })
+OPCODE(0x15, 1, "DEC D", { DE.high = dec8(DE.high); })
+OPCODE(0x16, 2, "LD D, d8", { DE.high = IMM8(); })
+OPCODE(0x17, 1, "RLA", { AF.high = rl8(AF.high); setFlag(Z, false); })
+OPCODE(0x18, 2, "JR s8", { s8 offset = (s8)IMM8(); PC.value += offset; cycles += 1; })
+OPCODE(0x19, 2, "ADD HL, DE", { addHL(DE.value); })
+OPCODE(0x1A, 2, "LD A, (DE)", { AF.high = bus->read(DE.value); })
+OPCODE(0x1B, 2, "DEC DE", { DE.value--; })
+OPCODE(0x1C, 1, "INC E", { DE.low = inc8(DE.low); })
+OPCODE(0x1D, 1, "DEC E", { DE.low = dec8(DE.low); })
+OPCODE(0x1E, 2, "LD E, d8", { DE.low = IMM8(); })
+OPCODE(0x1F, 1, "RRA", { AF.high = rr8(AF.high); setFlag(Z, false); })
+OPCODE(0x20, 2, "JR NZ, s8", { s8 offset = (s8)IMM8(); if (!getFlag(Z)) { PC.value += offset; cycles += 1; } })
+OPCODE(0x21, 3, "LD HL, d16", { HL.value = IMM16(); })
+OPCODE(0x22, 2, "LDI (HL+), A", { bus->write(HL.value++, AF.high); })
+OPCODE(0x23, 2, "INC HL", { HL.value++; })
+OPCODE(0x24, 1, "INC H", { HL.high = inc8(HL.high); })
+OPCODE(0x25, 1, "DEC H", { HL.high = dec8(HL.high); })
+OPCODE(0x26, 2, "LD H, d8", { HL.high = IMM8(); })
+OPCODE(0x27, 1, "DAA", { daa(); })
+OPCODE(0x28, 2, "JR Z, s8", { s8 offset = (s8)IMM8(); if (getFlag(Z)) { PC.value += offset; cycles += 1; } })
+OPCODE(0x29, 2, "ADD HL, HL", { addHL(HL.value); })
+OPCODE(0x2A, 2, "LD A, (HL+)", { AF.high = bus->read(HL.value++); })
+OPCODE(0x2B, 2, "DEC HL", { HL.value--; })
+OPCODE(0x2C, 1, "INC L", { HL.low = inc8(HL.low); })
+OPCODE(0x2D, 1, "DEC L", { HL.low = dec8(HL.low); })
+OPCODE(0x2E, 2, "LD L, d8", { HL.low = IMM8(); })
+OPCODE(0x2F, 1, "CPL", { AF.high = ~AF.high; setFlag(N, true); setFlag(H, true); })
+OPCODE(0x30, 2, "JR NC, s8", { s8 offset = (s8)IMM8(); if (!getFlag(C)) { PC.value += offset; cycles += 1; } })
+OPCODE(0x31, 3, "LD SP, d16", { SP.value = IMM16(); })
+OPCODE(0x32, 2, "LDD (HL-), A", { bus->write(HL.value--, AF.high); })
+OPCODE(0x33, 2, "INC SP", { SP.value++; })
+OPCODE(0x34, 3, "INC (HL)", { bus->write(HL.value, inc8(bus->read(HL.value))); })
+OPCODE(0x35, 3, "DEC (HL)", { bus->write(HL.value, dec8(bus->read(HL.value))); })
+OPCODE(0x36, 3, "LD (HL), d8", { bus->write(HL.value, IMM8()); })
+OPCODE(0x37, 1, "SCF", { setFlag(C, true); setFlag(N, false); setFlag(H, false); })
+OPCODE(0x38, 2, "JR C, s8", { s8 offset = (s8)IMM8(); if (getFlag(C)) { PC.value += offset; cycles += 1; } })
+OPCODE(0x39, 2, "ADD HL, SP", { addHL(SP.value); })
+OPCODE(0x3A, 2, "LD A, (HL-)", { AF.high = bus->read(HL.value--); })
+OPCODE(0x3B, 2, "DEC SP", { SP.value--; })
+OPCODE(0x3C, 1, "INC A", { AF.high = inc8(AF.high); })
+OPCODE(0x3D, 1, "DEC A", { AF.high = dec8(AF.high); })
+OPCODE(0x3E, 2, "LD A, d8", { AF.high = IMM8(); })
+OPCODE(0x3F, 1, "CCF", { setFlag(C, !getFlag(C)); setFlag(N, false); setFlag(H, false); })
+OPCODE(0x40, 1, "LD B, B", { BC.high = BC.high; })
+OPCODE(0x41, 1, "LD B, C", { BC.high = BC.low; })
+OPCODE(0x42, 1, "LD B, D", { BC.high = DE.high; })
+OPCODE(0x43, 1, "LD B, E", { BC.high = DE.low; })
+OPCODE(0x44, 1, "LD B, H", { BC.high = HL.high; })
+OPCODE(0x45, 1, "LD B, L", { BC.high = HL.low; })
+OPCODE(0x46, 2, "LD B, (HL)", { BC.high = bus->read(HL.value); })
+OPCODE(0x47, 1, "LD B, A", { BC.high = AF.high; })
+OPCODE(0x48, 1, "LD C, B", { BC.low = BC.high; })
+OPCODE(0x49, 1, "LD C, C", { BC.low = BC.low; })
+OPCODE(0x4A, 1, "LD C, D", { BC.low = DE.high; })
+OPCODE(0x4B, 1, "LD C, E", { BC.low = DE.low; })
+OPCODE(0x4C, 1, "LD C, H", { BC.low = HL.high; })
+OPCODE(0x4D, 1, "LD C, L", { BC.low = HL.low; })
+OPCODE(0x4E, 2, "LD C, (HL)", { BC.low = bus->read(HL.value); })
+OPCODE(0x4F, 1, "LD C, A", { BC.low = AF.high; })
+OPCODE(0x50, 1, "LD D, B", { DE.high = BC.high; })
+OPCODE(0x51, 1, "LD D, C", { DE.high = BC.low; })
+OPCODE(0x52, 1, "LD D, D", { DE.high = DE.high; })
+OPCODE(0x53, 1, "LD D, E", { DE.high = DE.low; })
+OPCODE(0x54, 1, "LD D, H", { DE.high = HL.high; })
+OPCODE(0x55, 1, "LD D, L", { DE.high = HL.low; })
+OPCODE(0x56, 2, "LD D, (HL)", { DE.high = bus->read(HL.value); })
+OPCODE(0x57, 1, "LD D, A", { DE.high = AF.high; })
+OPCODE(0x58, 1, "LD E, B", { DE.low = BC.high; })
+OPCODE(0x59, 1, "LD E, C", { DE.low = BC.low; })
+OPCODE(0x5A, 1, "LD E, D", { DE.low = DE.high; })
+OPCODE(0x5B, 1, "LD E, E", { DE.low = DE.low; })
+OPCODE(0x5C, 1, "LD E, H", { DE.low = HL.high; })
+OPCODE(0x5D, 1, "LD E, L", { DE.low = HL.low; })
+OPCODE(0x5E, 2, "LD E, (HL)", { DE.low = bus->read(HL.value); })
+OPCODE(0x5F, 1, "LD E, A", { DE.low = AF.high; })
+OPCODE(0x60, 1, "LD H, B", { HL.high = BC.high; })
+OPCODE(0x61, 1, "LD H, C", { HL.high = BC.low; })
+OPCODE(0x62, 1, "LD H, D", { HL.high = DE.high; })
+OPCODE(0x63, 1, "LD H, E", { HL.high = DE.low; })
+OPCODE(0x64, 1, "LD H, H", { HL.high = HL.high; })
+OPCODE(0x65, 1, "LD H, L", { HL.high = HL.low; })
+OPCODE(0x66, 2, "LD H, (HL)", { HL.high = bus->read(HL.value); })
+OPCODE(0x67, 1, "LD H, A", { HL.high = AF.high; })
+OPCODE(0x68, 1, "LD L, B", { HL.low = BC.high; })
+OPCODE(0x69, 1, "LD L, C", { HL.low = BC.low; })
+OPCODE(0x6A, 1, "LD L, D", { HL.low = DE.high; })
+OPCODE(0x6B, 1, "LD L, E", { HL.low = DE.low; })
+OPCODE(0x6C, 1, "LD L, H", { HL.low = HL.high; })
+OPCODE(0x6D, 1, "LD L, L", { HL.low = HL.low; })
+OPCODE(0x6E, 2, "LD L, (HL)", { HL.low = bus->read(HL.value); })
+OPCODE(0x6F, 1, "LD L, A", { HL.low = AF.high; })
+OPCODE(0x70, 1, "LD (HL), B", { bus->write(HL.value, BC.high); })
+OPCODE(0x71, 1, "LD (HL), C", { bus->write(HL.value, BC.low); })
+OPCODE(0x72, 1, "LD (HL), D", { bus->write(HL.value, DE.high); })
+OPCODE(0x73, 1, "LD (HL), E", { bus->write(HL.value, DE.low); })
+OPCODE(0x74, 1, "LD (HL), H", { bus->write(HL.value, HL.high); })
+OPCODE(0x75, 1, "LD (HL), L", { bus->write(HL.value, HL.low); })
+OPCODE(0x76, 1, "HALT", { stopped = true; })
+OPCODE(0x77, 1, "LD (HL), A", { bus->write(HL.value, AF.high); })
+OPCODE(0x78, 1, "LD A, B", { AF.high = BC.high; })
+OPCODE(0x79, 1, "LD A, C", { AF.high = BC.low; })
+OPCODE(0x7A, 1, "LD A, D", { AF.high = DE.high; })
+OPCODE(0x7B, 1, "LD A, E", { AF.high = DE.low; })
+OPCODE(0x7C, 1, "LD A, H", { AF.high = HL.high; })
+OPCODE(0x7D, 1, "LD A, L", { AF.high = HL.low; })
+OPCODE(0x7E, 2, "LD A, (HL)", { AF.high = bus->read(HL.value); })
+OPCODE(0x7F, 1, "LD A, A", { AF.high = AF.high; })
+OPCODE(0x80, 1, "ADD A, B", { add8(BC.high); })
+OPCODE(0x81, 1, "ADD A, C", { add8(BC.low); })
+OPCODE(0x82, 1, "ADD A, D", { add8(DE.high); })
+OPCODE(0x83, 1, "ADD A, E", { add8(DE.low); })
+OPCODE(0x84, 1, "ADD A, H", { add8(HL.high); })
+OPCODE(0x85, 1, "ADD A, L", { add8(HL.low); })
+OPCODE(0x86, 2, "ADD A, (HL)", { add8(bus->read(HL.value)); })
+OPCODE(0x87, 1, "ADD A, A", { add8(AF.high); })
+OPCODE(0x88, 2, "ADC A, B", { adc8(BC.high); })
+OPCODE(0x89, 2, "ADC A, C", { adc8(BC.low); })
+OPCODE(0x8A, 2, "ADC A, D", { adc8(DE.high); })
+OPCODE(0x8B, 2, "ADC A, E", { adc8(DE.low); })
+OPCODE(0x8C, 2, "ADC A, H", { adc8(HL.high); })
+OPCODE(0x8D, 2, "ADC A, L", { adc8(HL.low); })
+OPCODE(0x8E, 2, "ADC A, (HL)", { adc8(bus->read(HL.value)); })
+OPCODE(0x8F, 2, "ADC A, A", { adc8(AF.high); })
+OPCODE(0x90, 1, "SUB B", { sub8(BC.high); })
+OPCODE(0x91, 1, "SUB C", { sub8(BC.low); })
+OPCODE(0x92, 1, "SUB D", { sub8(DE.high); })
+OPCODE(0x93, 1, "SUB E", { sub8(DE.low); })
+OPCODE(0x94, 1, "SUB H", { sub8(HL.high); })
+OPCODE(0x95, 1, "SUB L", { sub8(HL.low); })
+OPCODE(0x96, 2, "SUB (HL)", { sub8(bus->read(HL.value)); })
+OPCODE(0x97, 1, "SUB A", { sub8(AF.high); })
+OPCODE(0x98, 2, "SBC A, B", { sbc8(BC.high); })
+OPCODE(0x99, 2, "SBC A, C", { sbc8(BC.low); })
+OPCODE(0x9A, 2, "SBC A, D", { sbc8(DE.high); })
+OPCODE(0x9B, 2, "SBC A, E", { sbc8(DE.low); })
+OPCODE(0x9C, 2, "SBC A, H", { sbc8(HL.high); })
+OPCODE(0x9D, 2, "SBC A, L", { sbc8(HL.low); })
+OPCODE(0x9E, 2, "SBC A, (HL)", { sbc8(bus->read(HL.value)); })
+OPCODE(0x9F, 1, "SBC A, A", { sbc8(AF.high); })
+OPCODE(0xA0, 1, "AND B", { and8(BC.high); })
+OPCODE(0xA1, 1, "AND C", { and8(BC.low); })
+OPCODE(0xA2, 1, "AND D", { and8(DE.high); })
+OPCODE(0xA3, 1, "AND E", { and8(DE.low); })
+OPCODE(0xA4, 1, "AND H", { and8(HL.high); })
+OPCODE(0xA5, 1, "AND L", { and8(HL.low); })
+OPCODE(0xA6, 2, "AND (HL)", { and8(bus->read(HL.value)); })
+OPCODE(0xA7, 1, "AND A", { and8(AF.high); })
+OPCODE(0xA8, 1, "XOR B", { xor8(BC.high); })
+OPCODE(0xA9, 1, "XOR C", { xor8(BC.low); })
+OPCODE(0xAA, 1, "XOR D", { xor8(DE.high); })
+OPCODE(0xAB, 1, "XOR E", { xor8(DE.low); })
+OPCODE(0xAC, 1, "XOR H", { xor8(HL.high); })
+OPCODE(0xAD, 1, "XOR L", { xor8(HL.low); })
+OPCODE(0xAE, 2, "XOR (HL)", { xor8(bus->read(HL.value)); })
+OPCODE(0xAF, 1, "XOR A", { xor8(AF.high); })
+OPCODE(0xB0, 1, "OR B", { or8(BC.high); })
+OPCODE(0xB1, 1, "OR C", { or8(BC.low); })
+OPCODE(0xB2, 1, "OR D", { or8(DE.high); })
+OPCODE(0xB3, 1, "OR E", { or8(DE.low); })
+OPCODE(0xB4, 1, "OR H", { or8(HL.high); })
+OPCODE(0xB5, 1, "OR L", { or8(HL.low); })
+OPCODE(0xB6, 2, "OR (HL)", { or8(bus->read(HL.value)); })
+OPCODE(0xB7, 1, "OR A", { or8(AF.high); })
+OPCODE(0xB8, 1, "CP B", { cp8(BC.high); })
+OPCODE(0xB9, 1, "CP C", { cp8(BC.low); })
+OPCODE(0xBA, 1, "CP D", { cp8(DE.high); })
+OPCODE(0xBB, 1, "CP E", { cp8(DE.low); })
+OPCODE(0xBC, 1, "CP H", { cp8(HL.high); })
+OPCODE(0xBD, 1, "CP L", { cp8(HL.low); })
+OPCODE(0xBE, 2, "CP (HL)", { cp8(bus->read(HL.value)); })
+OPCODE(0xBF, 1, "CP A", { cp8(AF.high); })
+OPCODE(0xC0, 2, "RET NZ", { if (!getFlag(Z)) { pop(PC); cycles += 3; } })
+OPCODE(0xC1, 3, "POP BC", { pop(BC); })
+OPCODE(0xC2, 3, "JP NZ, a16", { u16 addr = IMM16(); if (!getFlag(Z)) { PC.value = addr; cycles += 1; } })
+OPCODE(0xC3, 4, "JP a16", { PC.value = IMM16(); cycles += 1; })
+OPCODE(0xC4, 3, "CALL NZ, a16", { u16 addr = IMM16(); if (!getFlag(Z)) { push(PC); PC.value = addr; cycles += 3; } })
+OPCODE(0xC5, 4, "PUSH BC", { push(BC); })
+OPCODE(0xC6, 2, "ADD A, d8", { add8(IMM8()); })
+OPCODE(0xC7, 4, "RST 0", { push(PC); PC.value = 0x00; })
+OPCODE(0xC8, 2, "RET Z", { if (getFlag(Z)) { pop(PC); cycles += 3; } })
+OPCODE(0xC9, 4, "RET", { pop(PC); })
+OPCODE(0xCA, 3, "JP Z, a16", { u16 addr = IMM16(); if (getFlag(Z)) { PC.value = addr; cycles += 1; } })
+OPCODE(0xCB, 0, "???", { throw new exception("INVALID OPCODE"); })
+OPCODE(0xCC, 3, "CALL Z, a16", { u16 addr = IMM16(); if (getFlag(Z)) { push(PC); PC.value = addr; cycles += 3; } })
+OPCODE(0xCD, 3, "CALL a16", { u16 addr = IMM16(); push(PC); PC.value = addr; cycles += 3; })
+OPCODE(0xCE, 2, "ADC A, d8", { adc8(IMM8()); })
+OPCODE(0xCF, 4, "RST 1", { push(PC); PC.value = 0x08; })
+OPCODE(0xD0, 2, "RET NC", { if (!getFlag(C)) { pop(PC); cycles += 3; } })
+OPCODE(0xD1, 3, "POP DE", { pop(DE); })
+OPCODE(0xD2, 3, "JP NC, a16", { u16 addr = IMM16(); if (!getFlag(C)) { PC.value = addr; cycles += 1; } })
+OPCODE(0xD3, 0, "???", { throw new exception("INVALID OPCODE"); })
+OPCODE(0xD4, 3, "CALL NC, a16", { u16 addr = IMM16(); if (!getFlag(C)) { push(PC); PC.value = addr; cycles += 3; } })
+OPCODE(0xD5, 4, "PUSH DE", { push(DE); })
+OPCODE(0xD6, 2, "SUB d8", { sub8(IMM8()); })
+OPCODE(0xD7, 4, "RST 2", { push(PC); PC.value = 0x10; })
+OPCODE(0xD8, 2, "RET C", { if (getFlag(C)) { pop(PC); cycles += 3; } })
+OPCODE(0xD9, 4, "RETI", { pop(PC); interuptsEnabled = true; })
+OPCODE(0xDA, 3, "JP C, a16", { u16 addr = IMM16(); if (getFlag(C)) { PC.value = addr; cycles += 1; } })
+OPCODE(0xDB, 0, "???", { throw new exception("INVALID OPCODE"); })
+OPCODE(0xDC, 3, "CALL C, a16", { u16 addr = IMM16(); if (getFlag(C)) { push(PC); PC.value = addr; cycles += 3; } })
+OPCODE(0xDD, 0, "???", { throw new exception("INVALID OPCODE"); })
+OPCODE(0xDE, 2, "SBC A, d8", { sbc8(IMM8()); })
+OPCODE(0xDF, 4, "RST 3", { push(PC); PC.value = 0x18; })
+OPCODE(0xE0, 3, "LDH (a8), A", { bus->write(IMM8() + 0xFF00, AF.high); })
+OPCODE(0xE1, 3, "POP HL", { pop(HL); })
+OPCODE(0xE2, 2, "LD (C), A", { bus->write(BC.low + 0xFF00, AF.high); })
+OPCODE(0xE3, 0, "???", { throw new exception("INVALID OPCODE"); })
+OPCODE(0xE4, 0, "???", { throw new exception("INVALID OPCODE"); })
+OPCODE(0xE5, 4, "PUSH HL", { push(HL); })
+OPCODE(0xE6, 2, "AND d8", { and8(IMM8()); })
+OPCODE(0xE7, 4, "RST 4", { push(PC); PC.value = 0x20; })
+OPCODE(0xE8, 4, "ADD SP, s8", { addSP((s8)IMM8()); })
+OPCODE(0xE9, 1, "JP HL", { PC.value = HL.value; })
+OPCODE(0xEA, 4, "LD (a16), A", { bus->write(IMM16(), AF.high); })
+OPCODE(0xEB, 0, "???", { throw new exception("INVALID OPCODE"); })
+OPCODE(0xEC, 0, "???", { throw new exception("INVALID OPCODE"); })
+OPCODE(0xED, 0, "???", { throw new exception("INVALID OPCODE"); })
+OPCODE(0xEE, 2, "XOR d8", { xor8(IMM8()); })
+OPCODE(0xEF, 4, "RST 5", { push(PC); PC.value = 0x28; })
+OPCODE(0xF0, 3, "LDH A, (a8)", { AF.high = bus->read(IMM8() + 0xFF00); })
+OPCODE(0xF1, 3, "POP AF", { pop(AF); AF.low &= 0xF0; lazy.op = FlagOp::None; })
+OPCODE(0xF2, 2, "LD A, (C)", { AF.high = bus->read(BC.low + 0xFF00); })
+OPCODE(0xF3, 1, "DI", { interuptsEnabled = false; imeDelay = 0; })
+OPCODE(0xF4, 0, "???", { throw new exception("INVALID OPCODE"); })
+OPCODE(0xF5, 4, "PUSH AF", { flushFlags(); push(AF); })
+OPCODE(0xF6, 2, "OR d8", { or8(IMM8()); })
+OPCODE(0xF7, 4, "RST 6", { push(PC); PC.value = 0x30; })
+OPCODE(0xF8, 3, "LD HL, SP+s8", { ldHLSP((s8)IMM8()); })
+OPCODE(0xF9, 2, "LD SP, HL", { SP.value = HL.value; })
+OPCODE(0xFA, 4, "LD A, (a16)", { AF.high = bus->read(IMM16()); })
+OPCODE(0xFB, 1, "EI", { imeDelay = 2; })
+OPCODE(0xFC, 0, "???", { throw new exception("INVALID OPCODE"); })
+OPCODE(0xFD, 0, "???", { throw new exception("INVALID OPCODE"); })
+OPCODE(0xFE, 2, "CP d8", { cp8(IMM8()); })
+OPCODE(0xFF, 4, "RST 7", { push(PC); PC.value = 0x38; })
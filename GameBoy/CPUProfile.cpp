@@ -0,0 +1,57 @@
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+
+#include "CPU.h"
+#include "definitions.h"
+
+using namespace std;
+
+// Opcode histogram for CPU_PROFILE_OPCODES builds. Every engine calls
+// profileOpcode after executing an instruction; the dynarec interprets all
+// blocks in these builds so nothing is missed.
+
+#if CPU_PROFILE_OPCODES
+
+static const char* const opcodeNames[256] = {
+#define OPCODE(code, cyc, name, ...) name,
+#include "CPUOpcodes.inl"
+#undef OPCODE
+};
+
+static string cbName(u8 instruction) {
+	static const char* const registers[8] = { "B", "C", "D", "E", "H", "L", "(HL)", "A" };
+	static const char* const shifts[8] = { "RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL" };
+	static const char* const bitOps[4] = { "", "BIT", "RES", "SET" };
+
+	string reg = registers[instruction & 0x7];
+	u8 bitNumber = (instruction >> 3) & 0x7;
+	if (instruction < 0x40) return string(shifts[bitNumber]) + " " + reg;
+	return string(bitOps[instruction >> 6]) + " " + to_string(bitNumber) + ", " + reg;
+}
+
+// One row per opcode that was executed: opcode, name, count, cycles. Then one
+// row per fused sequence with its count.
+void CPU::dumpOpcodeProfile(const string& path) {
+	ofstream csv(path);
+	csv << "opcode,name,count,cycles" << endl;
+	for (int i = 0; i < 512; i++) {
+		if (opcodeCounts[i] == 0) continue;
+		char code[8];
+		snprintf(code, sizeof(code), i < 0x100 ? "%02X" : "CB%02X", i & 0xFF);
+		string name = i < 0x100 ? opcodeNames[i] : cbName(i & 0xFF);
+		csv << code << ",\"" << name << "\"," << opcodeCounts[i] << "," << opcodeCycles[i] << endl;
+	}
+
+	// Fused sequences (CPUFusion.cpp), their ops are also counted above
+	static const char* const fusedNames[(int)FusedOp::Count] = {
+		"", "DEC r; JR NZ", "LDH A, (a8); AND/CP", "LDH A, (a8); AND/CP; JR Z/NZ", "LD A, (HL+); LD (DE), A", "LD A, B; OR C; JR NZ"
+	};
+	for (int i = 1; i < (int)FusedOp::Count; i++) {
+		if (fusedCounts[i] == 0) continue;
+		csv << "FUSED" << i << ",\"" << fusedNames[i] << "\"," << fusedCounts[i] << "," << endl;
+	}
+}
+
+#endif
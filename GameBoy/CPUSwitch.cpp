@@ -0,0 +1,556 @@
+#include <string>
+#include <iostream>
+
+#include "CPU.h"
+#include "definitions.h"
+#include "Bus.h"
+
+using namespace std;
+
+// Labels-as-values are a GCC/Clang extension
+#if defined(__GNUC__) || defined(__clang__)
+#define CPU_COMPUTED_GOTO 1
+#else
+#define CPU_COMPUTED_GOTO 0
+#endif
+
+// Switch-dispatched execution engine. Decodes the same instruction set as the
+// std::function lookup table in CPU.cpp, but every handler is a plain case in
+// a switch so no closures are created or called per instruction.
+
+int CPU::stepSwitch() {
+	int cycles = 0;
+	u8 instruction = fetch();
+	if (instruction == 0xCB) {
+		u8 cb = fetch();
+		cycles = executeCB(cb);
+		profileOpcode(0x100 | cb, cycles);
+		return cycles;
+	}
+	switch (instruction) {
+#define IMM8() fetch()
+#define IMM16() doubleFetch()
+#define OPCODE(code, cyc, name, ...) case code: { cycles = cyc; __VA_ARGS__ } break;
+#include "CPUOpcodes.inl"
+#undef OPCODE
+#undef IMM16
+#undef IMM8
+	}
+	profileOpcode(instruction, cycles);
+	return cycles;
+}
+
+// Same handlers as stepSwitch, with operands taken from the decoded op. PC
+// must already point past the instruction.
+int CPU::executeDecoded(const DecodedOp& op) {
+	int cycles = 0;
+	if (op.opcode == 0xCB) {
+		cycles = executeCB(op.operand);
+		profileOpcode(0x100 | op.operand, cycles);
+		return cycles;
+	}
+	switch (op.opcode) {
+#define IMM8() ((u8)op.operand)
+#define IMM16() (op.operand)
+#define OPCODE(code, cyc, name, ...) case code: { cycles = cyc; __VA_ARGS__ } break;
+#include "CPUOpcodes.inl"
+#undef OPCODE
+#undef IMM16
+#undef IMM8
+	}
+	profileOpcode(op.opcode, cycles);
+	return cycles;
+}
+
+// Runs pre-decoded blocks from the block cache. Interrupts are still checked
+// before every instruction (or fused sequence), so a block is left early when
+// one is taken.
+void CPU::runCached(u64 cycleDeadline) {
+	bool checked = false;
+	idling = false;
+	while (cycleCount < cycleDeadline) {
+		if (!checked) checkInterupt();
+		checked = false;
+		if (stopped) {
+			cycleCount = cycleDeadline;
+			return;
+		}
+		if (codeDirty) purgeStaleBlocks();
+
+		// Code read while OAM DMA has the pages unmapped is all 0xFF, step
+		// through it rather than decoding (and keeping) blocks of it
+		if (bus->isDmaActive()) {
+			cycleCount += stepSwitch();
+			continue;
+		}
+
+		Block& block = getBlock(PC.value);
+		u64 passStart = cycleCount;
+		bool completed = false;
+		if (engine != CPUEngine::Dynarec || !runNative(block, cycleDeadline, completed)) {
+			for (size_t i = 0;;) {
+				const DecodedOp& op = block.ops[i];
+				if (op.fused != FusedOp::None && canRunFused(cycleDeadline)) {
+					cycleCount += executeFused(&op);
+					i += op.span;
+				}
+				else {
+					PC.value += op.length;
+					cycleCount += executeDecoded(op);
+					i++;
+				}
+				completed = i == block.ops.size();
+				// A write to cached code ends the block, it may have modified itself
+				if (completed || cycleCount >= cycleDeadline || codeDirty) break;
+				if (checkInterupt()) {
+					checked = true;
+					break;
+				}
+			}
+		}
+
+		// Idle loop branched back to itself: only the PPU or an interrupt can end
+		// it, and neither happens before the deadline. Skip the whole passes that
+		// fit, the last one runs as usual so it stops at the same instruction.
+		idling = idleLoopSkip && completed && block.idleLoop && PC.value == block.start;
+		if (idling && cycleCount < cycleDeadline) {
+			checked = true;
+			if (checkInterupt()) continue;
+			u64 pass = cycleCount - passStart;
+			cycleCount += (cycleDeadline - cycleCount - 1) / pass * pass;
+		}
+	}
+}
+
+// Direct-threaded engine. Each handler ends with its own copy of the dispatch
+// sequence (labels-as-values), so runs of instructions never return to a
+// central loop. Compilers without computed goto fall back to the switch.
+void CPU::runThreaded(u64 cycleDeadline) {
+#if CPU_COMPUTED_GOTO
+	static const void* const dispatch[256] = {
+#define OPCODE(code, cyc, name, ...) (code == 0xCB) ? &&prefix_cb : &&op_##code,
+#include "CPUOpcodes.inl"
+#undef OPCODE
+	};
+
+	int cycles = 0;
+	u8 instruction;
+
+#define IMM8() fetch()
+#define IMM16() doubleFetch()
+#define DISPATCH() \
+	cycleCount += cycles; \
+	if (cycleCount >= cycleDeadline) return; \
+	checkInterupt(); \
+	if (stopped) { cycleCount = cycleDeadline; return; } \
+	instruction = fetch(); \
+	goto *dispatch[instruction];
+
+	if (cycleCount >= cycleDeadline) return;
+	checkInterupt();
+	if (stopped) { cycleCount = cycleDeadline; return; }
+	instruction = fetch();
+	goto *dispatch[instruction];
+
+prefix_cb:
+	instruction = fetch();
+	cycles = executeCB(instruction);
+	profileOpcode(0x100 | instruction, cycles);
+	DISPATCH();
+
+#define OPCODE(code, cyc, name, ...) op_##code: { cycles = cyc; __VA_ARGS__ } profileOpcode(code, cycles); DISPATCH();
+#include "CPUOpcodes.inl"
+#undef OPCODE
+#undef DISPATCH
+#undef IMM16
+#undef IMM8
+#else
+	while (cycleCount < cycleDeadline) {
+		checkInterupt();
+		if (stopped) { cycleCount = cycleDeadline; return; }
+		cycleCount += stepSwitch();
+	}
+#endif
+}
+
+int CPU::executeCB(u8 instruction) {
+	u8 index = instruction & 0x7;
+	u8 bitNumber = (instruction >> 3) & 0x7;
+	u8 val = readR8(index);
+	int cycles = (index == 6) ? 4 : 2;
+
+	switch (instruction >> 6) {
+	case 0:
+		switch (bitNumber) {
+		case 0: val = rlc8(val); break;
+		case 1: val = rrc8(val); break;
+		case 2: val = rl8(val); break;
+		case 3: val = rr8(val); break;
+		case 4: val = sla8(val); break;
+		case 5: val = sra8(val); break;
+		case 6: val = swap8(val); break;
+		case 7: val = srl8(val); break;
+		}
+		break;
+	case 1: // BIT
+		setFlag(Z, ((val >> bitNumber) & 0x1) == 0);
+		setFlag(N, false);
+		setFlag(H, true);
+		return cycles;
+	case 2: // RES
+		val &= ~(0x1 << bitNumber);
+		break;
+	case 3: // SET
+		val |= 0x1 << bitNumber;
+		break;
+	}
+	writeR8(index, val);
+	return cycles;
+}
+
+u8 CPU::readR8(u8 index) {
+	switch (index) {
+	case 0: return BC.high;
+	case 1: return BC.low;
+	case 2: return DE.high;
+	case 3: return DE.low;
+	case 4: return HL.high;
+	case 5: return HL.low;
+	case 6: return bus->read(HL.value);
+	default: return AF.high;
+	}
+}
+
+void CPU::writeR8(u8 index, u8 val) {
+	switch (index) {
+	case 0: BC.high = val; break;
+	case 1: BC.low = val; break;
+	case 2: DE.high = val; break;
+	case 3: DE.low = val; break;
+	case 4: HL.high = val; break;
+	case 5: HL.low = val; break;
+	case 6: bus->write(HL.value, val); break;
+	default: AF.high = val; break;
+	}
+}
+
+void CPU::push(Register& reg) {
+	bus->write(--SP.value, reg.high);
+	bus->write(--SP.value, reg.low);
+}
+
+void CPU::pop(Register& reg) {
+	reg.low = bus->read(SP.value++);
+	reg.high = bus->read(SP.value++);
+}
+
+// With CPU_LAZY_FLAGS the 8-bit ALU helpers only record their operands, most
+// results are overwritten before anything reads F. getFlag, setFlag and PUSH AF
+// call evalFlags to bring AF.low up to date first.
+void CPU::evalFlags() {
+	u8 a = lazy.a;
+	u8 b = lazy.b;
+	u8 f = 0;
+	switch (lazy.op) {
+	case FlagOp::Add: {
+		int result = a + b + lazy.carry;
+		if ((u8)result == 0) f |= Z;
+		if (((a & 0xF) + (b & 0xF) + lazy.carry) > 0xF) f |= H;
+		if (result > 0xFF) f |= C;
+		break;
+	}
+	case FlagOp::Sub: {
+		int result = a - b - lazy.carry;
+		f |= N;
+		if ((u8)result == 0) f |= Z;
+		if ((a & 0xF) - (b & 0xF) - lazy.carry < 0) f |= H;
+		if (result < 0) f |= C;
+		break;
+	}
+	case FlagOp::And:
+		f |= H;
+		if (a == 0) f |= Z;
+		break;
+	case FlagOp::Or:
+		if (a == 0) f |= Z;
+		break;
+	case FlagOp::Inc:
+		if (lazy.carry) f |= C;
+		if ((u8)(a + 1) == 0) f |= Z;
+		if ((a & 0xF) == 0xF) f |= H;
+		break;
+	case FlagOp::Dec:
+		f |= N;
+		if (lazy.carry) f |= C;
+		if ((u8)(a - 1) == 0) f |= Z;
+		if ((a & 0xF) == 0) f |= H;
+		break;
+	default:
+		return;
+	}
+	AF.low = f;
+	lazy.op = FlagOp::None;
+}
+
+#if CPU_LAZY_FLAGS
+
+// C alone is cheap to work out, so ADC, SBC, INC and DEC don't need a full
+// evalFlags
+u8 CPU::carryFlag() {
+	switch (lazy.op) {
+	case FlagOp::None: return (AF.low & C) ? 1 : 0;
+	case FlagOp::Add: return (lazy.a + lazy.b + lazy.carry > 0xFF) ? 1 : 0;
+	case FlagOp::Sub: return (lazy.a - lazy.b - lazy.carry < 0) ? 1 : 0;
+	case FlagOp::Inc:
+	case FlagOp::Dec: return lazy.carry;
+	default: return 0;
+	}
+}
+
+void CPU::add8(u8 val) {
+	lazy = { FlagOp::Add, AF.high, val, 0 };
+	AF.high += val;
+}
+
+void CPU::adc8(u8 val) {
+	u8 carry = carryFlag();
+	lazy = { FlagOp::Add, AF.high, val, carry };
+	AF.high += val + carry;
+}
+
+void CPU::sub8(u8 val) {
+	lazy = { FlagOp::Sub, AF.high, val, 0 };
+	AF.high -= val;
+}
+
+void CPU::sbc8(u8 val) {
+	u8 carry = carryFlag();
+	lazy = { FlagOp::Sub, AF.high, val, carry };
+	AF.high -= val + carry;
+}
+
+void CPU::and8(u8 val) {
+	AF.high &= val;
+	lazy = { FlagOp::And, AF.high, 0, 0 };
+}
+
+void CPU::xor8(u8 val) {
+	AF.high ^= val;
+	lazy = { FlagOp::Or, AF.high, 0, 0 };
+}
+
+void CPU::or8(u8 val) {
+	AF.high |= val;
+	lazy = { FlagOp::Or, AF.high, 0, 0 };
+}
+
+void CPU::cp8(u8 val) {
+	lazy = { FlagOp::Sub, AF.high, val, 0 };
+}
+
+// INC and DEC leave C alone, it is carried over from the previous op
+u8 CPU::inc8(u8 val) {
+	lazy = { FlagOp::Inc, val, 0, carryFlag() };
+	return val + 1;
+}
+
+u8 CPU::dec8(u8 val) {
+	lazy = { FlagOp::Dec, val, 0, carryFlag() };
+	return val - 1;
+}
+
+#else
+
+void CPU::add8(u8 val) {
+	u8 a = AF.high;
+	clearFlags();
+	setFlag(H, ((a & 0xF) + (val & 0xF)) > 0xF);
+	setFlag(C, a + val > 0xFF);
+	AF.high = a + val;
+	setFlag(Z, AF.high == 0);
+}
+
+void CPU::adc8(u8 val) {
+	int carry = getFlag(C) ? 1 : 0;
+	int result = AF.high + val + carry;
+	clearFlags();
+	setFlag(Z, static_cast<u8>(result) == 0);
+	setFlag(C, result > 0xFF);
+	setFlag(H, ((AF.high & 0xF) + (val & 0xF) + carry) > 0xF);
+	AF.high = result;
+}
+
+void CPU::sub8(u8 val) {
+	int result = AF.high - val;
+	int carrybits = AF.high ^ val ^ result;
+	AF.high = result;
+	clearFlags();
+	setFlag(N, true);
+	setFlag(Z, (result & 0xFF) == 0);
+	setFlag(C, (carrybits & 0x100) != 0);
+	setFlag(H, (carrybits & 0x10) != 0);
+}
+
+void CPU::sbc8(u8 val) {
+	int carry = getFlag(C) ? 1 : 0;
+	int result = AF.high - val - carry;
+	setFlag(N, true);
+	setFlag(C, result < 0);
+	setFlag(H, (AF.high & 0xF) - (val & 0xF) - carry < 0);
+	AF.high = result;
+	setFlag(Z, AF.high == 0);
+}
+
+void CPU::and8(u8 val) {
+	AF.high &= val;
+	clearFlags();
+	setFlag(H, true);
+	setFlag(Z, AF.high == 0);
+}
+
+void CPU::xor8(u8 val) {
+	AF.high ^= val;
+	clearFlags();
+	setFlag(Z, AF.high == 0);
+}
+
+void CPU::or8(u8 val) {
+	AF.high |= val;
+	clearFlags();
+	setFlag(Z, AF.high == 0);
+}
+
+void CPU::cp8(u8 val) {
+	u8 a = AF.high;
+	setFlag(N, true);
+	setFlag(C, a < val);
+	setFlag(H, (val & 0xF) > (a & 0xF));
+	setFlag(Z, a == val);
+}
+
+u8 CPU::inc8(u8 val) {
+	u8 res = val + 1;
+	setFlag(N, false);
+	setFlag(Z, res == 0);
+	setFlag(H, (val & 0xF) == 0xF);
+	return res;
+}
+
+u8 CPU::dec8(u8 val) {
+	u8 res = val - 1;
+	setFlag(N, true);
+	setFlag(Z, res == 0);
+	setFlag(H, (val & 0xF) == 0);
+	return res;
+}
+
+#endif
+
+void CPU::addHL(u16 val) {
+	int res = HL.value + val;
+	setFlag(N, false);
+	setFlag(C, res & 0x10000);
+	setFlag(H, (HL.value ^ val ^ (res & 0xFFFF)) & 0x1000);
+	HL.value = res;
+}
+
+void CPU::addSP(s8 number) {
+	int result = SP.value + number;
+	clearFlags();
+	setFlag(C, ((SP.value ^ number ^ (result & 0xFFFF)) & 0x100) == 0x100);
+	setFlag(H, ((SP.value ^ number ^ (result & 0xFFFF)) & 0x10) == 0x10);
+	SP.value = result;
+}
+
+void CPU::ldHLSP(s8 val) {
+	HL.value = SP.value + val;
+	clearFlags();
+	setFlag(C, ((SP.value ^ val ^ HL.value) & 0x100) == 0x100);
+	setFlag(H, ((SP.value ^ val ^ HL.value) & 0x10) == 0x10);
+}
+
+void CPU::daa() {
+	int a = AF.high;
+
+	if (!getFlag(N)) {
+		if (getFlag(H) || ((a & 0xF) > 9)) a += 0x06;
+		if (getFlag(C) || (a > 0x9F)) a += 0x60;
+	}
+	else {
+		if (getFlag(H)) a = (a - 6) & 0xFF;
+		if (getFlag(C)) a -= 0x60;
+	}
+
+	setFlag(H, false);
+	if ((a & 0x100) == 0x100) setFlag(C, true);
+
+	a &= 0xFF;
+	setFlag(Z, a == 0);
+
+	AF.high = a;
+}
+
+u8 CPU::rlc8(u8 val) {
+	u8 top = val >> 7;
+	u8 res = (val << 1) | top;
+	clearFlags();
+	setFlag(C, top);
+	setFlag(Z, res == 0);
+	return res;
+}
+
+u8 CPU::rl8(u8 val) {
+	u8 res = (val << 1) | (getFlag(C) ? 1 : 0);
+	clearFlags();
+	setFlag(C, val >> 7);
+	setFlag(Z, res == 0);
+	return res;
+}
+
+u8 CPU::rrc8(u8 val) {
+	u8 bottom = val & 0x1;
+	u8 res = (val >> 1) | (bottom << 7);
+	clearFlags();
+	setFlag(C, bottom);
+	setFlag(Z, res == 0);
+	return res;
+}
+
+u8 CPU::rr8(u8 val) {
+	u8 res = (val >> 1) | ((getFlag(C) ? 1 : 0) << 7);
+	clearFlags();
+	setFlag(C, val & 0x1);
+	setFlag(Z, res == 0);
+	return res;
+}
+
+u8 CPU::sla8(u8 val) {
+	u8 res = val << 1;
+	clearFlags();
+	setFlag(C, val >> 7);
+	setFlag(Z, res == 0);
+	return res;
+}
+
+u8 CPU::sra8(u8 val) {
+	u8 res = (val >> 1) | (val & 0x80);
+	clearFlags();
+	setFlag(C, val & 0x1);
+	setFlag(Z, res == 0);
+	return res;
+}
+
+u8 CPU::srl8(u8 val) {
+	u8 res = val >> 1;
+	clearFlags();
+	setFlag(C, val & 0x1);
+	setFlag(Z, res == 0);
+	return res;
+}
+
+u8 CPU::swap8(u8 val) {
+	u8 res = (val << 4) | (val >> 4);
+	clearFlags();
+	setFlag(Z, res == 0);
+	return res;
+}
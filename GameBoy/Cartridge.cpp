@@ -0,0 +1,244 @@
+#include <algorithm>
+
+#include "Cartridge.h"
+#include "definitions.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+Cartridge::~Cartridge() {
+	if (saveView == nullptr) return;
+	syncSave(0, ramSize, true);
+#ifdef _WIN32
+	UnmapViewOfFile(saveView);
+#else
+	munmap(saveView, ramSize);
+#endif
+}
+
+// The image is whole 16 KiB banks and at least 32 KiB (see RomRegistry)
+void Cartridge::load(shared_ptr<const RomImage> romImage, const string& savePath) {
+	image = romImage;
+	rom = romImage->data();
+
+	u8 type = rom[0x147];
+	switch (type) {
+	case 0x01: case 0x02: case 0x03:
+		mbc = MBC::MBC1;
+		break;
+	case 0x0F: case 0x10:
+		mbc = MBC::MBC3;
+		hasRtc = true;
+		break;
+	case 0x11: case 0x12: case 0x13:
+		mbc = MBC::MBC3;
+		break;
+	case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x1D: case 0x1E:
+		mbc = MBC::MBC5;
+		break;
+	default: // ROM only, or a mapper that is not emulated
+		mbc = MBC::None;
+		break;
+	}
+	hasBattery = type == 0x03 || type == 0x0F || type == 0x10 || type == 0x13 || type == 0x1B || type == 0x1E;
+
+	static const u32 ramSizes[6] = { 0, 0x800, 0x2000, 0x8000, 0x20000, 0x10000 };
+	ramSize = rom[0x149] < 6 ? ramSizes[rom[0x149]] : 0;
+	if (ramSize > 0) ramSize = max<u32>(ramSize, 0x2000);
+	if (mbc == MBC::None) {
+		// Always mapped, as before there were mappers
+		ramSize = 0x2000;
+		ramEnabled = true;
+	}
+	if (hasBattery && ramSize > 0 && !savePath.empty()) mapSave(savePath);
+	if (saveView == nullptr) {
+		ram.assign(ramSize, 0);
+		ramData = ram.data();
+	}
+	rtcBase = time(nullptr);
+}
+
+// Maps the save file, created or grown to ramSize. RAM stays in memory if the
+// file can't be opened.
+void Cartridge::mapSave(const string& path) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return;
+	// Grows the file to ramSize if it is smaller
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, ramSize, nullptr);
+	CloseHandle(file);
+	if (mapping == nullptr) return;
+	void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, ramSize);
+	CloseHandle(mapping);
+	if (view == nullptr) return;
+#else
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0) return;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (info.st_size < ramSize && ftruncate(fd, ramSize) != 0)) {
+		::close(fd);
+		return;
+	}
+	void* view = mmap(nullptr, ramSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED) return;
+#endif
+	saveView = view;
+	ramData = (u8*)view;
+}
+
+void Cartridge::syncSave(u32 offset, u32 length, bool wait) {
+#ifdef _WIN32
+	FlushViewOfFile((u8*)saveView + offset, length);
+#else
+	// msync needs a page aligned start
+	static const u32 pageSize = (u32)sysconf(_SC_PAGESIZE);
+	u32 start = offset / pageSize * pageSize;
+	msync((u8*)saveView + start, offset + length - start, wait ? MS_SYNC : MS_ASYNC);
+#endif
+}
+
+// Schedules the chunks written since the last call to be written back, e.g.
+// once per frame. Only the exit in ~Cartridge waits for the disk.
+void Cartridge::flushSave() {
+	if (saveView == nullptr || dirtyChunks.none()) return;
+	u32 chunks = ramSize >> 12;
+	for (u32 chunk = 0; chunk < chunks; chunk++) {
+		if (!dirtyChunks[chunk]) continue;
+		u32 end = chunk;
+		while (end + 1 < chunks && dirtyChunks[end + 1]) end++;
+		syncSave(chunk << 12, (end - chunk + 1) << 12, false);
+		chunk = end;
+	}
+	dirtyChunks.reset();
+}
+
+u16 Cartridge::getRomBank(u16 addr) {
+	u32 bank;
+	if (addr <= 0x3FFF) {
+		bank = (mbc == MBC::MBC1 && ramMode) ? bankHigh << 5 : 0;
+	}
+	else if (mbc == MBC::None) {
+		bank = 1;
+	}
+	else if (mbc == MBC::MBC1) {
+		bank = bankHigh << 5 | romBank;
+	}
+	else {
+		bank = romBank;
+	}
+	return bank % romBanks();
+}
+
+u8* Cartridge::ramBankData() {
+	if (!ramEnabled || ramSize == 0) return nullptr;
+	u32 bank = 0;
+	if (mbc == MBC::MBC1 && ramMode) bank = bankHigh;
+	else if (mbc == MBC::MBC3) {
+		if (ramBank > 0x03) return nullptr; // RTC register
+		bank = ramBank;
+	}
+	else if (mbc == MBC::MBC5) bank = ramBank;
+	return ramData + (bank % ramBanks()) * 0x2000;
+}
+
+bool Cartridge::write(u16 addr, u8 val) {
+	switch (mbc) {
+	case MBC::MBC1:
+		if (addr <= 0x1FFF) ramEnabled = (val & 0x0F) == 0x0A;
+		else if (addr <= 0x3FFF) romBank = max(val & 0x1F, 1);
+		else if (addr <= 0x5FFF) bankHigh = val & 0x03;
+		else ramMode = val & 0x01;
+		return true;
+	case MBC::MBC3:
+		if (addr <= 0x1FFF) ramEnabled = (val & 0x0F) == 0x0A;
+		else if (addr <= 0x3FFF) romBank = max(val & 0x7F, 1);
+		else if (addr <= 0x5FFF) ramBank = val;
+		else {
+			// Writing 0 then 1 copies the clock into the readable registers
+			if (hasRtc && rtcLatch == 0x00 && val == 0x01) latchRtc();
+			rtcLatch = val;
+			return false;
+		}
+		return true;
+	case MBC::MBC5:
+		if (addr <= 0x1FFF) ramEnabled = (val & 0x0F) == 0x0A;
+		else if (addr <= 0x2FFF) romBank = (romBank & 0x100) | val;
+		else if (addr <= 0x3FFF) romBank = (romBank & 0xFF) | (val & 0x01) << 8;
+		else if (addr <= 0x5FFF) ramBank = val & 0x0F;
+		else return false;
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Only called for 0xA000-0xBFFF when ramBankData() is nullptr
+u8 Cartridge::readRam(u16) {
+	if (ramEnabled && hasRtc && 0x08 <= ramBank && ramBank <= 0x0C) return rtcLatched[ramBank - 0x08];
+	return 0xFF;
+}
+
+// Also called for every write to battery RAM, see tracksRamWrites
+void Cartridge::writeRam(u16 addr, u8 val) {
+	u8* bank = ramBankData();
+	if (bank != nullptr) {
+		bank[addr - 0xA000] = val;
+		dirtyChunks[(bank - ramData + (addr - 0xA000)) >> 12] = true;
+		return;
+	}
+	if (ramEnabled && hasRtc && 0x08 <= ramBank && ramBank <= 0x0C) writeRtc(ramBank, val);
+}
+
+u64 Cartridge::rtcSeconds() {
+	if (rtcHalt) return rtcHalted;
+	return (u64)(time(nullptr) - rtcBase);
+}
+
+void Cartridge::setRtcSeconds(u64 seconds) {
+	rtcHalted = seconds;
+	rtcBase = time(nullptr) - (time_t)seconds;
+}
+
+void Cartridge::latchRtc() {
+	u64 seconds = rtcSeconds();
+	if (seconds / 86400 > 0x1FF) {
+		// Day counter overflowed, the carry bit stays set until it is written
+		rtcCarry = true;
+		seconds %= 512 * 86400;
+		setRtcSeconds(seconds);
+	}
+	u64 days = seconds / 86400;
+	rtcLatched[0] = seconds % 60;
+	rtcLatched[1] = seconds / 60 % 60;
+	rtcLatched[2] = seconds / 3600 % 24;
+	rtcLatched[3] = days & 0xFF;
+	rtcLatched[4] = (days >> 8 & 0x01) | (rtcHalt ? 0x40 : 0) | (rtcCarry ? 0x80 : 0);
+}
+
+void Cartridge::writeRtc(u8 reg, u8 val) {
+	u64 seconds = rtcSeconds();
+	u64 s = seconds % 60, m = seconds / 60 % 60, h = seconds / 3600 % 24, d = seconds / 86400 % 512;
+	switch (reg) {
+	case 0x08: s = val % 60; break;
+	case 0x09: m = val % 60; break;
+	case 0x0A: h = val % 24; break;
+	case 0x0B: d = (d & 0x100) | val; break;
+	case 0x0C:
+		d = (d & 0xFF) | (val & 0x01) << 8;
+		rtcCarry = val & 0x80;
+		break;
+	}
+	setRtcSeconds(((d * 24 + h) * 60 + m) * 60 + s);
+	if (reg == 0x0C) rtcHalt = val & 0x40;
+	rtcLatched[reg - 0x08] = val;
+}
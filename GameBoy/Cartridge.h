@@ -0,0 +1,83 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <bitset>
+#include <ctime>
+
+#include "definitions.h"
+#include "RomRegistry.h"
+
+// Memory bank controller, from the cartridge type byte at 0x0147
+enum class MBC
+{
+	None, // 32 KiB ROM, optional 8 KiB RAM
+	MBC1,
+	MBC3, // optionally with a real time clock
+	MBC5
+};
+
+// ROM and RAM of the cartridge and its bank registers. The bus maps the
+// 0x0000-0x7FFF and 0xA000-0xBFFF pages straight into the banks returned
+// here, so a bank switch only repoints page table entries.
+class Cartridge {
+private:
+	std::shared_ptr<const RomImage> image; // shared with other instances
+	const u8* rom = nullptr;
+	std::vector<u8> ram;      // RAM of carts without a battery
+	u8* ramData = nullptr;    // ram, or the mapped save file
+	u32 ramSize = 0;
+	MBC mbc = MBC::None;
+	bool hasRtc = false;
+	bool hasBattery = false;
+
+	// Battery RAM is a MAP_SHARED view of the .sav file. Writes to it go through
+	// writeRam, which marks the 4 KiB chunks flushSave has to write back.
+	void* saveView = nullptr;
+	std::bitset<32> dirtyChunks;
+	void mapSave(const std::string& path);
+	void syncSave(u32 offset, u32 length, bool wait);
+
+	bool ramEnabled = false;
+	u16 romBank = 1;    // MBC1: low 5 bits, MBC3: 7 bits, MBC5: 9 bits
+	u8 bankHigh = 0;    // MBC1: 2 bits used for ROM bits 5-6 or the RAM bank
+	bool ramMode = false; // MBC1 banking mode 1
+	u8 ramBank = 0;     // MBC3: RAM bank 0-3 or RTC register 0x08-0x0C, MBC5: 0-15
+
+	// MBC3 real time clock, counted in seconds of host time
+	time_t rtcBase = 0;  // host time at which the clock read 0
+	u64 rtcHalted = 0;   // clock value while halted
+	bool rtcHalt = false;
+	bool rtcCarry = false;
+	u8 rtcLatch = 0xFF;  // last value written to 0x6000-0x7FFF
+	u8 rtcLatched[5] = {}; // S, M, H, DL, DH as read by the CPU
+
+	u64 rtcSeconds();
+	void setRtcSeconds(u64 seconds);
+	void latchRtc();
+	void writeRtc(u8 reg, u8 val);
+
+	u32 romBanks() { return image ? (u32)(image->size() / 0x4000) : 1; }
+	u32 ramBanks() { return ramSize / 0x2000; }
+
+public:
+	Cartridge() = default;
+	Cartridge(const Cartridge&) = delete;
+	~Cartridge();
+	// savePath is used if the cartridge has a battery
+	void load(std::shared_ptr<const RomImage> romImage, const std::string& savePath = "");
+	MBC getMBC() { return mbc; }
+
+	// Bank mapped at addr (0x0000-0x3FFF or 0x4000-0x7FFF) and its 16 KiB
+	u16 getRomBank(u16 addr);
+	const u8* romBankData(u16 addr) { return rom + getRomBank(addr) * 0x4000; }
+	// 8 KiB mapped at 0xA000, nullptr when reads need readRam (disabled, RTC)
+	u8* ramBankData();
+
+	// MBC registers, returns true if the mapping changed
+	bool write(u16 addr, u8 val);
+	u8 readRam(u16 addr);
+	void writeRam(u16 addr, u8 val);
+	bool tracksRamWrites() { return saveView != nullptr; }
+	void flushSave();
+};
@@ -10,6 +10,7 @@
 #define SCREEN_HEIGHT 144
 #define SCREEN_WIDTH 160
 #define PIXEL_SIZE 5
+#define CPU_SLICE 16 // M-cycles the CPU runs between PPU catch-ups
 
 using namespace std;
 
@@ -21,10 +22,9 @@ class GameBoy : public olc::PixelGameEngine, public Display
 private:
 	int clockSpeed = 4194304;
 	float residualTime = 0.0f;
-	int  cycles = 0;
-	int counter = 0;
+	u64 cycles = 0;
 	
-	CPU cpu;
+	CPU cpu{ CPUEngine::Threaded };
 	Bus* bus;
 	PPU ppu;
 
@@ -46,19 +46,20 @@ public:
 		else
 		{
 			residualTime += (1.0f / clockSpeed) - elapsedTime;
+			bool doneFrame = false;
 			do {
-				if (counter % 4 == 0) {
-					if (cycles == 0) {
-						cpu.checkInterupt();
-						if (!cpu.isStopped()) {
-							cycles = cpu.step();
-						}
-					}
-					cycles--;
+				// The PPU clock runs at 4 ticks per CPU cycle
+				if (cpu.isStopped() || cpu.isIdling()) {
+					// Halted or polling, nothing changes before the PPU's next event
+					cycles += (ppu.nextEventCycle() - cycles * 4) / 4;
+					cpu.runUntil(cycles);
+					ppu.advanceTo(cycles * 4);
 				}
-				ppu.step();
-				counter++;
-			} while (!ppu.isDoneFrame());
+				cycles += CPU_SLICE;
+				cpu.runUntil(cycles);
+				doneFrame = ppu.advanceTo(cycles * 4);
+			} while (!doneFrame);
+			bus->flushSave();
 		}
 
 		// Get user input and process
@@ -67,10 +68,20 @@ public:
 		return true;
 	}
 
-	void drawScanline(u8 row, vector<u8>* scanline) {
+	bool OnUserDestroy() override
+	{
+#if CPU_PROFILE_OPCODES
+		cpu.dumpOpcodeProfile("opcode_profile.csv");
+#endif
+		// Writes back the rest of the battery RAM
+		delete bus;
+		return true;
+	}
+
+	void drawScanline(u8 row, span<const u8> scanline) {
 		for (int i = 0; i < 160; i++) {
 			olc::Pixel p;
-			switch (scanline->at(i)) {
+			switch (scanline[i]) {
 			case 0:
 				p = LIGHTEST;
 				break;
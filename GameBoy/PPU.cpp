@@ -7,31 +7,17 @@
 #include <iterator>
 #include <algorithm>
 #include <span>
+#include <cstring>
 
 #include "PPU.h"
+#include "TileDecoder.h"
 #include "definitions.h"
 
 using namespace std;
 
-const u16 LCDC = 0xFF40;
-
 // See https://gbdev.io/pandocs/Rendering.html
 // Palettes: BGP (0xFF47), OBP0 (0xFF48), OBP1 (0xFF49)
 
-void tileToRowColours(span<u8> tile, u8 rowNum, vector<u8>* out) {
-	auto first = tile[rowNum * 2];
-	auto second = tile[rowNum * 2 + 1];
-	//u16 colours = 0;
-	u8 ptr = 0x80;
-	for (int i = 7; i >= 0; i--) {
-		u8 colour = (((second & ptr) >> i) << 1) | ((first & ptr) >> i);
-		//colours |= (colour << (2 * i));
-		ptr >>= 1;
-		out->emplace_back(colour);
-	}
-	return;
-}
-
 vector<Sprite> filterSprites(u8 scanline, vector<Sprite> sprites) {
 	vector<Sprite> res;
 	u8 height = (sprites[0].tiles.size() > 1) ? 16 : 8;
@@ -48,20 +34,12 @@ vector<Sprite> filterSprites(u8 scanline, vector<Sprite> sprites) {
 PPU::PPU() {}
 
 void PPU::step() {
-	if (this->DMA > 0) {
-		u8 page = this->bus->read(0xFF46);
-		u16 offset = 160 - this->DMA;
-		u16 srcAddr = page << 8 | offset;
-		u16 destAddr = 0xFE00 | offset;
-		this->bus->write(destAddr, this->bus->read(srcAddr));
-		this->DMA--;
-	}
-	else if (this->getLcdEnable() == 0) {
+	this->clock++;
+	if (this->getLcdEnable() == 0) {
 		return;
 	}
 	else {
 		this->setLY(this->scanline);
-		u8 status = this->bus->read(0xFF0F);
 		switch (mode) {
 		case 0: // HBlank
 			this->cycles += 1;
@@ -74,7 +52,7 @@ void PPU::step() {
 			return;
 		case 1: // VBlank
 			if (this->scanline == 144 && this->cycles == 0)
-				this->bus->write(0xFF0F, status | 1);
+				this->bus->write(0xFF0F, this->bus->read(0xFF0F) | 1);
 			this->cycles += 1;
 			if (this->cycles == 114) {
 				this->cycles = 0;
@@ -100,7 +78,7 @@ void PPU::step() {
 				// Create scanline
 				this->generateScanline();
 				// Send scanline to bus for display
-				this->bus->renderScanline(this->scanline, &currentLine);
+				this->bus->renderScanline(this->scanline, frameBuffer[this->scanline]);
 				this->cycles = 0;
 				this->setMode(0);
 			}
@@ -109,11 +87,72 @@ void PPU::step() {
 	}
 }
 
+// Number of step() calls from now that would only count cycles, i.e. before
+// the next mode or line change. Those are the only points where the PPU
+// renders, raises an interrupt or touches LY/STAT, so they can be skipped
+// with advance().
+u32 PPU::idleTicks() {
+	if (this->getLcdEnable() == 0) return 0;
+	// step() copies a new scanline to LY at the start of the line's first step
+	if (this->LY != this->scanline) return 0;
+	switch (mode) {
+	case 0: return 22 - 1 - this->cycles;
+	case 1: return (this->scanline == 144 && this->cycles == 0) ? 0 : 114 - 1 - this->cycles;
+	case 2: return 20 - 1 - this->cycles;
+	default: return 72 - 1 - this->cycles;
+	}
+}
+
+// Same as calling step() `ticks` times, for ticks <= idleTicks()
+void PPU::advance(u32 ticks) {
+	if (ticks == 0) return;
+	this->clock += ticks;
+	this->cycles += ticks;
+	if (mode == 2) doneFrame = false;
+}
+
+// A frame takes a few hundred events instead of 17556 steps
+bool PPU::advanceTo(u64 cycle) {
+	if (this->getLcdEnable() == 0) { // nothing happens until the CPU turns it on
+		if (this->clock < cycle) this->clock = cycle;
+		return false;
+	}
+	bool frameFinished = false;
+	while (this->clock < cycle) {
+		u64 event = this->nextEventCycle();
+		if (event >= cycle) {
+			this->advance((u32)(cycle - this->clock));
+			break;
+		}
+		this->advance((u32)(event - this->clock));
+		this->step();
+		frameFinished |= doneFrame;
+	}
+	return frameFinished;
+}
+
 bool spriteCompare(Sprite i, Sprite j) {
 	return i.xPos > j.xPos; // smaller xPos has priority -> render last
 }
 
+void PPU::decodeTile(u16 tile) {
+	span<u8> data = this->bus->readRange(0x8000 + tile * 16, 16);
+	// Colour indices, palettes can change without touching the tiles
+	decodeTileRows(data.data(), 8, 0xE4, tileCache[tile][0]);
+}
+
+// Tile data changes far less often than it is drawn, see Bus::isTileDirty
+void PPU::updateTileCache() {
+	if (!this->bus->isDirty(dirtyConsumer, 0x8000, 0x1800)) return;
+	for (u16 tile = 0; tile < 384; tile++) {
+		if (this->bus->isTileDirty(dirtyConsumer, tile)) decodeTile(tile);
+	}
+	this->bus->clearDirty(dirtyConsumer, 0x8000, 0x1800);
+}
+
 void PPU::generateScanline() {
+	updateTileCache();
+
 	// Gets Sprites
 	/*if (this->getObjEnable() == 1) {
 		vector<Sprite> sprites = filterSprites(this->scanline, this->getSprites());
@@ -190,20 +229,27 @@ Tile PPU::getSprite(u8 index) {
 void PPU::getTileMapRow(u8 index, u8 row, u8 x, u8 rowIndex) {
 	u16 addr = (index == 0) ? 0x9800 : 0x9C00;
 	addr += 32 * row;
-	vector<u8> total;
-	for (int j = 0; j < 32; j++) {
-		if (this->getTileIndexType() == 0) {
-			auto tile = this->getTile(this->bus->read(addr++));
-			tileToRowColours(tile, rowIndex, &total);
-		}
-		else {
-			auto tile = this->getTileSigned((s8) this->bus->read(addr++));
-			tileToRowColours(tile, rowIndex, &total);
-		}
+	// Straight from VRAM, bus reads are blocked during OAM DMA
+	span<u8> map = this->bus->readRange(addr, 32);
+
+	// 21 tiles cover the 160 pixels at any fine scroll, the map wraps around
+	u8 pixels[21 * 8];
+	u8 firstTile = x / 8;
+	bool unsignedIndex = this->getTileIndexType() == 0;
+	for (int j = 0; j < 21; j++) {
+		u8 index = map[(firstTile + j) & 0x1F];
+		// Same tiles as getTile and getTileSigned
+		u16 tile = unsignedIndex ? index : 128 + (s8)index;
+		memcpy(pixels + j * 8, tileCache[tile][rowIndex], 8);
 	}
 
-	auto start = total.begin() + x;
-	currentLine = vector(start, start + 160);
+	// BGP gives the shade of each colour
+	const u8 shades[4] = { (u8)(BGP & 0x3), (u8)(BGP >> 2 & 0x3), (u8)(BGP >> 4 & 0x3), (u8)(BGP >> 6) };
+	const u8* visible = pixels + x % 8;
+	u8* line = frameBuffer[this->scanline];
+	for (int i = 0; i < 160; i++) {
+		line[i] = shades[visible[i]];
+	}
 	return;
 }
 
@@ -224,7 +270,7 @@ vector<Sprite> PPU::getSprites() {
 			s.tiles.push_back(this->getTileSigned((s8)tilePos));
 		}
 
-		if ((this->bus->read(LCDC) >> 2) & 0x1) {
+		if ((this->LCDC >> 2) & 0x1) {
 			tilePos++;
 			if (this->getTileIndexType() == 0) {
 				s.tiles.push_back(this->getTile(tilePos));
@@ -243,119 +289,123 @@ vector<Sprite> PPU::getSprites() {
 
 void PPU::attachBus(Bus* bus) {
 	this->bus = bus;
+	dirtyConsumer = bus->subscribeDirty();
+	for (u16 tile = 0; tile < 384; tile++) decodeTile(tile);
+	bus->clearDirty(dirtyConsumer, 0x8000, 0x1800);
+	// 0xFF46 (OAM DMA) belongs to the bus
+	for (u16 port = 0xFF40; port <= 0xFF4B; port++) {
+		if (port == 0xFF46) continue;
+		bus->registerIO(port, [this](u16 addr) { return readRegister(addr); }, [this](u16 addr, u8 val) { writeRegister(addr, val); });
+	}
+}
+
+u8 PPU::readRegister(u16 addr) {
+	switch (addr) {
+	case 0xFF40: return LCDC;
+	case 0xFF41: // Mode and LY == LYC are read from the current state
+		return 0x80 | (STAT & 0x78) | (LY == LYC) << 2 | (this->getLcdEnable() ? mode : 0);
+	case 0xFF42: return SCY;
+	case 0xFF43: return SCX;
+	case 0xFF44: return LY;
+	case 0xFF45: return LYC;
+	case 0xFF47: return BGP;
+	case 0xFF48: return OBP0;
+	case 0xFF49: return OBP1;
+	case 0xFF4A: return WY;
+	default: return WX;
+	}
+}
+
+void PPU::writeRegister(u16 addr, u8 val) {
+	switch (addr) {
+	case 0xFF40: LCDC = val; break;
+	case 0xFF41: STAT = val & 0x78; break; // only the interrupt sources are writable
+	case 0xFF42: SCY = val; break;
+	case 0xFF43: SCX = val; break;
+	case 0xFF44: break; // LY is read only
+	case 0xFF45: LYC = val; break;
+	case 0xFF47: BGP = val; break;
+	case 0xFF48: OBP0 = val; break;
+	case 0xFF49: OBP1 = val; break;
+	case 0xFF4A: WY = val; break;
+	default: WX = val; break;
+	}
 }
 
 void PPU::setLCDC(u8 val) {
-	this->bus->write(LCDC, val);
+	this->LCDC = val;
 }
 
 u8 PPU::getLcdEnable() {
-	u8 lcdc = this->bus->read(LCDC);
-	return (lcdc >> 7) & 0x1;
+	return (LCDC >> 7) & 0x1;
 }
 
 u8 PPU::getWindowIndex() {
-	u8 lcdc = this->bus->read(LCDC);
-	return (lcdc >> 6) & 0x1;
+	return (LCDC >> 6) & 0x1;
 }
 
 u8 PPU::getWindowEnable() {
-	u8 lcdc = this->bus->read(LCDC);
-	return (lcdc >> 5) & 0x1;
+	return (LCDC >> 5) & 0x1;
 }
 
 u8 PPU::getTileIndexType() {
-	u8 lcdc = this->bus->read(LCDC);
-	return (lcdc >> 4) & 0x1;
+	return (LCDC >> 4) & 0x1;
 }
 
 u8 PPU::getBackgroundIndex() {
-	u8 lcdc = this->bus->read(LCDC);
-	return (lcdc >> 3) & 0x1;
+	return (LCDC >> 3) & 0x1;
 }
 
 u8 PPU::getObjSize() {
-	u8 lcdc = this->bus->read(LCDC);
-	return (lcdc >> 2) & 0x1;
+	return (LCDC >> 2) & 0x1;
 }
 
 u8 PPU::getObjEnable() {
-	u8 lcdc = this->bus->read(LCDC);
-	return (lcdc >> 1) & 0x1;
+	return (LCDC >> 1) & 0x1;
 }
 
 u8 PPU::getBgAndWindowEnablePriority() {
-	u8 lcdc = this->bus->read(LCDC);
-	return (lcdc >> 0) & 0x1;
+	return (LCDC >> 0) & 0x1;
 }
 
 
 u8 PPU::getSCY() {
-	return this->bus->read(0xFF42);
+	return SCY;
 }
 
 u8 PPU::getSCX() {
-	return this->bus->read(0xFF43);
+	return SCX;
 }
 
 u8 PPU::getWY() {
-	return this->bus->read(0xFF42);
+	return WY;
 }
 
 u8 PPU::getWX() {
-	return this->bus->read(0xFF43) - 7;
+	return WX - 7;
 }
 
 
 void PPU::setLycLyInteruptSource(bool b) {
-	u8 status = this->bus->read(0xFF41);
-	status |= b << 6;
-	this->bus->write(0xFF41, status);
+	STAT |= b << 6;
 }
 
 void PPU::setOamInteruptSource(bool b) {
-	u8 status = this->bus->read(0xFF41);
-	status |= b << 5;
-	this->bus->write(0xFF41, status);
+	STAT |= b << 5;
 }
 
 void PPU::setVBlankInteruptSource(bool b) {
-	u8 status = this->bus->read(0xFF41);
-	status |= b << 4;
-	this->bus->write(0xFF41, status);
+	STAT |= b << 4;
 }
 
 void PPU::setHBlankInteruptSource(bool b) {
-	u8 status = this->bus->read(0xFF41);
-	status |= b << 3;
-	this->bus->write(0xFF41, status);
-}
-
-void PPU::setLycLyFlag(bool b) {
-	u8 status = this->bus->read(0xFF41);
-	status &= (b << 2) | 0x0B;
-	this->bus->write(0xFF41, status);
-	// TODO: call interupt if needed
+	STAT |= b << 3;
 }
 
 void PPU::setMode(u8 mode) {
 	this->mode = mode;
-	u8 status = this->bus->read(0xFF41);
-	status |= mode;
-	this->bus->write(0xFF41, status);
 }
 
 void PPU::setLY(u8 scanline) {
-	this->bus->write(0xFF44, scanline);
-	u8 lyc = this->bus->read(0xFF45);
-	this->setLycLyFlag(lyc == scanline);
-}
-
-void PPU::handleLycSet() {
-	u8 lyc = this->bus->read(0xFF45);
-	this->setLycLyFlag(lyc == this->scanline);
-}
-
-void PPU::triggerDMA() {
-	this->DMA = 160;
+	this->LY = scanline;
 }
\ No newline at end of file
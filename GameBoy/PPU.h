@@ -22,17 +22,36 @@ struct Sprite {
 class PPU {
 private:
     Bus* bus = nullptr;
-
+    int dirtyConsumer = 0; // see Bus::subscribeDirty
+
+    // Registers 0xFF40-0xFF4B, the CPU reaches them through readRegister and
+    // writeRegister (see attachBus)
+    u8 LCDC = 0;
+    u8 STAT = 0; // interrupt sources only, the rest is added when read
+    u8 SCY = 0;
+    u8 SCX = 0;
     u8 LY = 0;
+    u8 LYC = 0;
+    u8 BGP = 0;
+    u8 OBP0 = 0;
+    u8 OBP1 = 0;
+    u8 WY = 0;
+    u8 WX = 0;
     u8 WLC = 0; // window line counter
 
-    u8 DMA = 0;
     u8 scanline = 0; // 154 per frame, 144-153 are VBlank
     u8 cycles = 0; // 456 dots (114 cpu cycles) per scanline
     u8 mode = 2;
+    u64 clock = 0; // step() calls so far, see advanceTo
 
     bool doneFrame = false;
-    std::vector<u8> currentLine;
+    u8 frameBuffer[144][160] = {}; // shades, drawn one line at a time
+
+    // Tiles at 0x8000-0x97FF decoded to one colour index per pixel. Tiles the
+    // CPU wrote to are decoded again before the next scanline.
+    u8 tileCache[384][8][8] = {};
+    void decodeTile(u16 tile);
+    void updateTileCache();
 
     //void triggerVBlank();
     //void triggerLCDC();
@@ -61,19 +80,29 @@ private:
     void setOamInteruptSource(bool b);
     void setVBlankInteruptSource(bool b);
     void setHBlankInteruptSource(bool b);
-    void setLycLyFlag(bool b);
     void setMode(u8 mode);
     void setLY(u8 scanline);
 
     void generateScanline();
+    u8 readRegister(u16 addr);
+    void writeRegister(u16 addr, u8 val);
+    u32 idleTicks();
+    void advance(u32 ticks);
 public:
     PPU();
     void step();
+    // Clock of the next step() that changes something: a mode or LY change
+    // (and with it LY == LYC), a rendered line or the VBlank interrupt. The
+    // current clock while the LCD is off.
+    u64 nextEventCycle() { return clock + idleTicks(); }
+    // Same as calling step() until the clock reaches cycle, but only steps at
+    // events. Returns true if a frame was finished on the way.
+    bool advanceTo(u64 cycle);
+    u64 getCycle() { return clock; }
     void attachBus(Bus* bus);
 
     void setLCDC(u8 val);
-    void triggerDMA();
 
-    void handleLycSet();
     bool isDoneFrame() { return doneFrame; }
+    const u8* getFrameBuffer() { return &frameBuffer[0][0]; }
 };
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+
+#include "RomRegistry.h"
+#include "definitions.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Cartridge banks are 16 KiB and two are mapped at once. Files of any other
+// size are copied and padded instead of mapped.
+static bool wholeBanks(size_t size) { return size >= 0x8000 && size % 0x4000 == 0; }
+
+static u64 hashBytes(const u8* bytes, size_t length) {
+	u64 hash = 14695981039346656037ull; // FNV-1a
+	for (size_t i = 0; i < length; i++) hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+static void* mapFile(const string& path, size_t size) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return nullptr;
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (mapping == nullptr) return nullptr;
+	// The view keeps the mapping alive
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+	CloseHandle(mapping);
+	return view;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return nullptr;
+	void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	return (view == MAP_FAILED) ? nullptr : view;
+#endif
+}
+
+RomImage::~RomImage() {
+	if (view == nullptr) return;
+#ifdef _WIN32
+	UnmapViewOfFile(view);
+#else
+	munmap(view, length);
+#endif
+}
+
+shared_ptr<RomImage> RomRegistry::copyImage(const vector<u8>& rom) {
+	if (rom.size() == 0) throw new exception("Error Reading File");
+
+	auto image = make_shared<RomImage>();
+	image->copy = rom;
+	image->copy.resize(max<size_t>(0x8000, (rom.size() + 0x3FFF) / 0x4000 * 0x4000), 0);
+	image->bytes = image->copy.data();
+	image->length = image->copy.size();
+	image->hash = hashBytes(image->bytes, image->length);
+	return image;
+}
+
+shared_ptr<const RomImage> RomRegistry::fromMemory(const vector<u8>& rom) {
+	return copyImage(rom);
+}
+
+shared_ptr<const RomImage> RomRegistry::open(const string& path) {
+	struct Entry {
+		weak_ptr<const RomImage> image;
+		u64 fileSize;
+		s64 fileTime;
+	};
+	static mutex lock;
+	static unordered_map<string, Entry> byPath;
+	static unordered_map<u64, weak_ptr<const RomImage>> byHash;
+
+	error_code error;
+	u64 fileSize = filesystem::file_size(path, error);
+	if (error || fileSize == 0) throw new exception("Error Reading File");
+	s64 fileTime = filesystem::last_write_time(path, error).time_since_epoch().count();
+
+	lock_guard<mutex> guard(lock);
+
+	// Entries only hold weak references, forget the ones whose image is gone
+	erase_if(byPath, [](const auto& entry) { return entry.second.image.expired(); });
+	erase_if(byHash, [](const auto& entry) { return entry.second.expired(); });
+
+	// Already open and not changed on disk since
+	auto found = byPath.find(path);
+	if (found != byPath.end() && found->second.fileSize == fileSize && found->second.fileTime == fileTime) {
+		if (auto image = found->second.image.lock()) return image;
+	}
+
+	shared_ptr<RomImage> image;
+	void* view = wholeBanks(fileSize) ? mapFile(path, fileSize) : nullptr;
+	if (view != nullptr) {
+		image = make_shared<RomImage>();
+		image->view = view;
+		image->bytes = (const u8*)view;
+		image->length = fileSize;
+		image->hash = hashBytes(image->bytes, image->length);
+	}
+	else {
+		ifstream stream(path, ios::binary);
+		vector<u8> contents((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+		image = copyImage(contents);
+	}
+
+	// Same contents under another path
+	shared_ptr<const RomImage> result = image;
+	auto& shared = byHash[image->hash];
+	auto other = shared.lock();
+	if (other && other->length == image->length && memcmp(other->bytes, image->bytes, image->length) == 0) {
+		result = other;
+	}
+	else {
+		shared = image;
+	}
+	byPath[path] = { result, fileSize, fileTime };
+	return result;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "definitions.h"
+
+// Read-only ROM image, a mapping of the file or, for sizes that are not whole
+// 16 KiB banks, a padded copy
+class RomImage {
+private:
+	friend class RomRegistry;
+
+	const u8* bytes = nullptr;
+	size_t length = 0;
+	u64 hash = 0;
+	void* view = nullptr; // mapped view, nullptr for copies
+	std::vector<u8> copy;
+
+public:
+	~RomImage();
+	const u8* data() const { return bytes; }
+	size_t size() const { return length; }
+	u64 getHash() const { return hash; }
+};
+
+// ROM images shared by every Bus in the process. Files are mapped once per
+// path, and a file whose contents hash the same as one already open (e.g. a
+// copy under another name) shares that mapping. An image is unmapped when the
+// last Cartridge using it goes away.
+class RomRegistry {
+private:
+	static std::shared_ptr<RomImage> copyImage(const std::vector<u8>& rom);
+
+public:
+	static std::shared_ptr<const RomImage> open(const std::string& path);
+	// Image of a ROM already in memory, e.g. a test program. Not shared.
+	static std::shared_ptr<const RomImage> fromMemory(const std::vector<u8>& rom);
+};
@@ -0,0 +1,143 @@
+#include <cstring>
+
+#include "TileDecoder.h"
+#include "definitions.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TILE_DECODER_SIMD 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define TILE_DECODER_SIMD 0
+#endif
+
+// Each pixel is (high bit << 1 | low bit) of its column, leftmost pixel in
+// bit 7, looked up in the palette. The vector versions spread each plane byte
+// over 8 lanes, turn the bits into lane masks and pick one of four broadcast
+// shades with and/andnot, so the palette costs nothing extra.
+
+static void decodeScalar(const u8* planes, u32 rows, u8 palette, u8* out) {
+	const u8 shades[4] = { (u8)(palette & 0x3), (u8)(palette >> 2 & 0x3), (u8)(palette >> 4 & 0x3), (u8)(palette >> 6) };
+	for (u32 row = 0; row < rows; row++) {
+		u8 low = planes[row * 2];
+		u8 high = planes[row * 2 + 1];
+		for (int i = 7; i >= 0; i--) {
+			*out++ = shades[(low >> i & 1) | (high >> i & 1) << 1];
+		}
+	}
+}
+
+#if TILE_DECODER_SIMD
+
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+// Byte n of a row is the mask for pixel n
+const u64 PIXEL_BITS = 0x0102040810204080ull;
+
+// Takes lanes holding a row's plane byte 8 times over to the row's shades
+#define SELECT_SHADES(prefix, si, low, high) \
+	low = prefix##_cmpeq_epi8(prefix##_and_##si(low, bits), bits); \
+	high = prefix##_cmpeq_epi8(prefix##_and_##si(high, bits), bits); \
+	high = prefix##_or_##si( \
+		prefix##_andnot_##si(high, prefix##_or_##si(prefix##_andnot_##si(low, shade0), prefix##_and_##si(low, shade1))), \
+		prefix##_and_##si(high, prefix##_or_##si(prefix##_andnot_##si(low, shade2), prefix##_and_##si(low, shade3))))
+
+static void decodeSSE2(const u8* planes, u32 rows, u8 palette, u8* out) {
+	const __m128i bits = _mm_set1_epi64x(PIXEL_BITS);
+	const __m128i shade0 = _mm_set1_epi8(palette & 0x3);
+	const __m128i shade1 = _mm_set1_epi8(palette >> 2 & 0x3);
+	const __m128i shade2 = _mm_set1_epi8(palette >> 4 & 0x3);
+	const __m128i shade3 = _mm_set1_epi8(palette >> 6);
+
+	// 8 rows at a time: split the planes, then widen each byte to 8 lanes
+	u32 row = 0;
+	for (; row + 8 <= rows; row += 8, planes += 16, out += 64) {
+		__m128i v = _mm_loadu_si128((const __m128i*)planes);
+		__m128i lows = _mm_packus_epi16(_mm_and_si128(v, _mm_set1_epi16(0xFF)), v);
+		__m128i highs = _mm_packus_epi16(_mm_srli_epi16(v, 8), v);
+		lows = _mm_unpacklo_epi8(lows, lows);
+		highs = _mm_unpacklo_epi8(highs, highs);
+		__m128i lowQuads[2] = { _mm_unpacklo_epi16(lows, lows), _mm_unpackhi_epi16(lows, lows) };
+		__m128i highQuads[2] = { _mm_unpacklo_epi16(highs, highs), _mm_unpackhi_epi16(highs, highs) };
+		for (int i = 0; i < 2; i++) {
+			__m128i low = _mm_unpacklo_epi32(lowQuads[i], lowQuads[i]);
+			__m128i high = _mm_unpacklo_epi32(highQuads[i], highQuads[i]);
+			SELECT_SHADES(_mm, si128, low, high);
+			_mm_storeu_si128((__m128i*)(out + i * 32), high);
+			low = _mm_unpackhi_epi32(lowQuads[i], lowQuads[i]);
+			high = _mm_unpackhi_epi32(highQuads[i], highQuads[i]);
+			SELECT_SHADES(_mm, si128, low, high);
+			_mm_storeu_si128((__m128i*)(out + i * 32 + 16), high);
+		}
+	}
+	decodeScalar(planes, rows - row, palette, out);
+}
+
+TARGET_AVX2 static void decodeAVX2(const u8* planes, u32 rows, u8 palette, u8* out) {
+	const __m256i bits = _mm256_set1_epi64x(PIXEL_BITS);
+	const __m256i shade0 = _mm256_set1_epi8(palette & 0x3);
+	const __m256i shade1 = _mm256_set1_epi8(palette >> 2 & 0x3);
+	const __m256i shade2 = _mm256_set1_epi8(palette >> 4 & 0x3);
+	const __m256i shade3 = _mm256_set1_epi8(palette >> 6);
+	// Row n of the 4 goes to lanes 8n-8n+7, shuffles stay within 128-bit halves
+	const __m256i lowIndex = _mm256_setr_epi8(
+		0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 2, 2, 2, 2,
+		4, 4, 4, 4, 4, 4, 4, 4, 6, 6, 6, 6, 6, 6, 6, 6);
+	const __m256i highIndex = _mm256_add_epi8(lowIndex, _mm256_set1_epi8(1));
+
+	u32 row = 0;
+	for (; row + 4 <= rows; row += 4, planes += 8, out += 32) {
+		u64 chunk;
+		memcpy(&chunk, planes, 8);
+		__m256i v = _mm256_set1_epi64x(chunk);
+		__m256i low = _mm256_shuffle_epi8(v, lowIndex);
+		__m256i high = _mm256_shuffle_epi8(v, highIndex);
+		SELECT_SHADES(_mm256, si256, low, high);
+		_mm256_storeu_si256((__m256i*)out, high);
+	}
+	decodeScalar(planes, rows - row, palette, out);
+}
+
+static bool hasAVX2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = info[2] & (1 << 27);
+	if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) return false; // OS saves YMM registers
+	__cpuidex(info, 7, 0);
+	return info[1] & (1 << 5);
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+TileDecoder bestTileDecoder() {
+#if TILE_DECODER_SIMD
+	static const TileDecoder best = hasAVX2() ? TileDecoder::AVX2 : TileDecoder::SSE2;
+	return best;
+#else
+	return TileDecoder::Scalar;
+#endif
+}
+
+void decodeTileRows(const u8* planes, u32 rows, u8 palette, u8* out, TileDecoder decoder) {
+#if TILE_DECODER_SIMD
+	if (decoder == TileDecoder::AVX2 && bestTileDecoder() == TileDecoder::AVX2) {
+		decodeAVX2(planes, rows, palette, out);
+		return;
+	}
+	if (decoder != TileDecoder::Scalar) {
+		decodeSSE2(planes, rows, palette, out);
+		return;
+	}
+#endif
+	decodeScalar(planes, rows, palette, out);
+}
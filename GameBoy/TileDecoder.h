@@ -0,0 +1,20 @@
+#pragma once
+
+#include "definitions.h"
+
+// Implementations of decodeTileRows
+enum class TileDecoder
+{
+	Scalar,
+	SSE2, // x86-64 only
+	AVX2  // x86-64 hosts that support it
+};
+
+// Fastest decoder the host supports, checked once
+TileDecoder bestTileDecoder();
+
+// Turns 2bpp tile rows into one shade per pixel. planes holds two bytes per
+// row as stored in VRAM (low bits, then high bits) and out gets 8 pixels per
+// row. The rows don't have to be from one tile, e.g. one row of each tile in a
+// map row. palette is a BGP/OBP0/OBP1 value, 0xE4 keeps the colour indices.
+void decodeTileRows(const u8* planes, u32 rows, u8 palette, u8* out, TileDecoder decoder = bestTileDecoder());
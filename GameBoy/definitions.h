@@ -5,6 +5,7 @@
 
 #include <stdint.h>
 #include <vector>
+#include <span>
 
 typedef uint8_t u8;
 typedef int8_t s8;
@@ -17,7 +18,8 @@ typedef int64_t s64;
 
 class Display {
 public:
-	virtual void drawScanline(u8 row, std::vector<u8>* colours) = 0;
+	// 160 shades (0-3) of line row, valid until the PPU draws the next frame
+	virtual void drawScanline(u8 row, std::span<const u8> colours) = 0;
 };
 
 #endif
\ No newline at end of file
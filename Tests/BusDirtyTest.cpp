@@ -0,0 +1,42 @@
+#include "pch.h"
+
+#include <vector>
+
+#include "CPU.h"
+#include "Bus.h"
+#include "PPU.h"
+
+using namespace std;
+
+class NullDisplay : public Display {
+public:
+	void drawScanline(u8 row, span<const u8> colours) override {}
+};
+
+// The PPU's tile cache clears VRAM lines as it decodes them, a second
+// consumer of the same range must still see every write
+TEST(BusDirty, ConsumersClearIndependently) {
+	NullDisplay display;
+	PPU ppu;
+	CPU cpu;
+	Bus bus(&cpu, &ppu, &display, vector<u8>(0x8000, 0));
+	cpu.attachBus(&bus);
+	ppu.attachBus(&bus);
+	bus.write(0xFF40, 0x91); // LCD on, the tile cache is refreshed every line
+
+	int other = bus.subscribeDirty();
+	EXPECT_TRUE(bus.isDirty(other, 0xC000, 0x2000)); // nothing seen yet
+	bus.clearDirty(other, 0x8000, 0x2000);
+	bus.clearDirty(other, 0xC000, 0x2000);
+
+	bus.write(0x8010, 1); // tile 1
+	for (int i = 0; i < 154 * 114; i++) ppu.step(); // the PPU consumes it
+	EXPECT_TRUE(bus.isTileDirty(other, 1));
+	EXPECT_FALSE(bus.isTileDirty(other, 2));
+
+	bus.clearDirty(other, 0x8000, 0x2000);
+	EXPECT_FALSE(bus.isDirty(other, 0x8000, 0x2000));
+	bus.write(0xC123, 2);
+	EXPECT_TRUE(bus.isDirty(other, 0xC120, 16));
+	EXPECT_FALSE(bus.isDirty(other, 0xC130, 16));
+}
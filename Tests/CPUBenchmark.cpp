@@ -0,0 +1,93 @@
+#include "pch.h"
+
+#include <chrono>
+#include <iostream>
+
+#include "CPU.h"
+#include "Bus.h"
+#include "PPU.h"
+
+using namespace std;
+
+class NullDisplay : public Display {
+public:
+	void drawScanline(u8 row, span<const u8> colours) override {}
+};
+
+// ALU-heavy loop at 0x0100. Every ALU instruction overwrites the flags of the
+// one before, F is only read by the JR NZ and PUSH AF. Each pass of the outer
+// loop stores AF to 0xC000 so engines can be compared.
+static vector<u8> aluLoopRom() {
+	vector<u8> rom(0x8000, 0);
+	const u8 program[] = {
+		0x06, 0x00,             // LD B, 0
+		0x0E, 0x01,             // LD C, 1
+		0x16, 0x02,             // LD D, 2
+		0x1E, 0x03,             // LD E, 3
+		0x80,                   // loop: ADD A, B
+		0x89,                   // ADC A, C
+		0x92,                   // SUB D
+		0x9B,                   // SBC A, E
+		0xA8,                   // XOR B
+		0xA1,                   // AND C
+		0xB2,                   // OR D
+		0xBB,                   // CP E
+		0x14,                   // INC D
+		0x1D,                   // DEC E
+		0x0C,                   // INC C
+		0x20, 0xF3,             // JR NZ, loop
+		0x04,                   // INC B
+		0xF5,                   // PUSH AF
+		0xE1,                   // POP HL
+		0x7D,                   // LD A, L
+		0xEA, 0x00, 0xC0,       // LD (0xC000), A
+		0x7C,                   // LD A, H
+		0xEA, 0x01, 0xC0,       // LD (0xC001), A
+		0x18, 0xE6,             // JR loop
+	};
+	copy(begin(program), end(program), rom.begin() + 0x100);
+	return rom;
+}
+
+static double runAluLoop(CPU& cpu, u64 cycles) {
+	auto start = chrono::steady_clock::now();
+	for (u64 t = 1000; t <= cycles; t += 1000) cpu.runUntil(t);
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static const char* engineNames[] = { "Table", "Switch", "Threaded", "BlockCache", "Dynarec" };
+
+// Runs the loop on `engine` and the eager table engine to the same cycle and
+// compares what it stored. Returns the seconds the engine took.
+static double checkAluLoop(CPUEngine engine, u64 cycles) {
+	vector<u8> rom = aluLoopRom();
+	NullDisplay display;
+	PPU ppu;
+	CPU cpu{ engine };
+	Bus bus(&cpu, &ppu, &display, rom);
+	cpu.attachBus(&bus);
+	ppu.attachBus(&bus);
+	double seconds = runAluLoop(cpu, cycles);
+
+	CPU reference;
+	Bus referenceBus(&reference, &ppu, &display, rom);
+	reference.attachBus(&referenceBus);
+	reference.runUntil(cpu.getCycles());
+	EXPECT_EQ(bus.read(0xC000), referenceBus.read(0xC000)) << engineNames[(int)engine];
+	EXPECT_EQ(bus.read(0xC001), referenceBus.read(0xC001)) << engineNames[(int)engine];
+	return seconds;
+}
+
+TEST(CPUEngines, AluLoopMatchesTable) {
+	for (int e = 0; e <= (int)CPUEngine::Dynarec; e++) checkAluLoop((CPUEngine)e, 200000);
+}
+
+// Timing only, run with --gtest_also_run_disabled_tests
+TEST(CPUBenchmark, DISABLED_AluLoop) {
+	const u64 cycles = 20000000;
+	for (int e = 0; e <= (int)CPUEngine::Dynarec; e++) {
+		double seconds = checkAluLoop((CPUEngine)e, cycles);
+		cout << engineNames[e] << ": " << (cycles / seconds / 1e6) << " M-cycles/s"
+			<< " (lazy flags " << (CPU_LAZY_FLAGS ? "on" : "off") << ")" << endl;
+	}
+}
@@ -0,0 +1,105 @@
+#include "pch.h"
+
+#include "CPU.h"
+#include "Bus.h"
+#include "PPU.h"
+
+using namespace std;
+
+class NullDisplay : public Display {
+public:
+	void drawScanline(u8 row, span<const u8> colours) override {}
+};
+
+// Loops at 0x0150 that mix the instructions the dynarec emits natively (ALU
+// ops on registers, (HL) and d8, reads through (HL+), JR/JP on Z and C) with
+// called ones (stores, PUSH/POP, INC (HL)). Results go to 0xC000, the stack
+// at 0xC0EC and the table at 0xC100.
+static vector<u8> mixedLoopRom() {
+	vector<u8> rom(0x8000, 0);
+	const u8 entry[] = { 0xC3, 0x50, 0x01 }; // JP 0x0150
+	const u8 program[] = {
+		0x31, 0xF0, 0xC0,       // LD SP, 0xC0F0
+		0x21, 0x00, 0xC1,       // LD HL, 0xC100
+		0x06, 0x10,             // LD B, 0x10
+		0x78,                   // fill: LD A, B
+		0xC6, 0x37,             // ADD A, 0x37
+		0x22,                   // LD (HL+), A
+		0x05,                   // DEC B
+		0x20, 0xF9,             // JR NZ, fill
+		0x21, 0x00, 0xC1,       // outer: LD HL, 0xC100
+		0x0E, 0x0F,             // LD C, 0x0F
+		0x2A,                   // inner: LD A, (HL+)
+		0x8A,                   // ADC A, D
+		0x57,                   // LD D, A
+		0x9E,                   // SBC A, (HL)
+		0x5F,                   // LD E, A
+		0xFE, 0x80,             // CP 0x80
+		0x38, 0x02,             // JR C, small
+		0xAB,                   // XOR E
+		0x1C,                   // INC E
+		0x0D,                   // small: DEC C
+		0xC2, 0x64, 0x01,       // JP NZ, inner
+		0x06, 0x05,             // LD B, 5
+		0x80,                   // spin: ADD A, B
+		0x3C,                   // INC A
+		0x05,                   // DEC B
+		0x20, 0xFB,             // JR NZ, spin
+		0xF5,                   // PUSH AF
+		0xD5,                   // PUSH DE
+		0xE1,                   // POP HL
+		0xE1,                   // POP HL
+		0x21, 0x00, 0xC1,       // LD HL, 0xC100
+		0x34,                   // INC (HL)
+		0x7B,                   // LD A, E
+		0x86,                   // ADD A, (HL)
+		0x30, 0x02,             // JR NC, nc
+		0x3D,                   // DEC A
+		0x3D,                   // DEC A
+		0xEA, 0x00, 0xC0,       // nc: LD (0xC000), A
+		0x8F,                   // ADC A, A
+		0x9F,                   // SBC A, A
+		0xCA, 0x5F, 0x01,       // JP Z, outer
+		0x2F,                   // CPL
+		0xA7,                   // AND A
+		0xB1,                   // OR C
+		0xEA, 0x01, 0xC0,       // LD (0xC001), A
+		0xC3, 0x5F, 0x01,       // JP outer
+	};
+	copy(begin(entry), end(entry), rom.begin() + 0x100);
+	copy(begin(program), end(program), rom.begin() + 0x150);
+	return rom;
+}
+
+// Runs the dynarec and the switch interpreter side by side in slices of
+// `slice` M-cycles, as the frame loop does, and compares them after each one
+static void compareWithInterpreter(u64 slice, u64 cycles) {
+	vector<u8> rom = mixedLoopRom();
+	NullDisplay display;
+	PPU ppu;
+	CPU cpu{ CPUEngine::Dynarec };
+	Bus bus(&cpu, &ppu, &display, rom);
+	cpu.attachBus(&bus);
+	CPU reference{ CPUEngine::Switch };
+	Bus referenceBus(&reference, &ppu, &display, rom);
+	reference.attachBus(&referenceBus);
+
+	for (u64 t = slice; t <= cycles; t += slice) {
+		cpu.runUntil(t);
+		reference.runUntil(t);
+		ASSERT_EQ(cpu.getCycles(), reference.getCycles()) << "slice " << slice << " at " << t;
+		for (u16 addr = 0xC000; addr < 0xC110; addr++) {
+			ASSERT_EQ(bus.read(addr), referenceBus.read(addr)) << "slice " << slice << " at " << t << ", 0x" << hex << addr;
+		}
+	}
+}
+
+TEST(CPUDynarec, MatchesInterpreterInFrameSlices) {
+	compareWithInterpreter(16, 200000);
+}
+
+TEST(CPUDynarec, MatchesInterpreterInOddSlices) {
+	compareWithInterpreter(1, 50000);
+	compareWithInterpreter(7, 100000);
+	compareWithInterpreter(114, 200000);
+}
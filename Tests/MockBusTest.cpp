@@ -0,0 +1,58 @@
+#include "pch.h"
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "CPU.h"
+#include "Bus.h"
+
+using namespace std;
+
+// Bus over a flat 64 KiB array that records every access. No page is mapped,
+// so the CPU reaches it through readSlow/writeSlow for fetches too.
+class MockBus : public Bus {
+public:
+	vector<u8> memory = vector<u8>(0x10000, 0);
+	vector<u16> reads;
+	vector<pair<u16, u8>> writes;
+
+	MockBus(CPU* cpu) : Bus(cpu) {}
+
+protected:
+	u8 readSlow(u16 addr) override {
+		reads.push_back(addr);
+		return memory[addr];
+	}
+	void writeSlow(u16 addr, u8 val) override {
+		writes.push_back({ addr, val });
+		memory[addr] = val;
+	}
+};
+
+TEST(MockBus, RecordsCPUAccesses) {
+	const u8 program[] = {
+		0x3E, 0x42,             // LD A, 0x42
+		0xEA, 0x00, 0xC0,       // LD (0xC000), A
+		0x21, 0x00, 0xC0,       // LD HL, 0xC000
+		0x34,                   // INC (HL)
+		0x7E,                   // LD A, (HL)
+		0xE0, 0x80,             // LDH (0x80), A
+		0x76,                   // HALT
+	};
+	const char* names[] = { "Table", "Switch", "Threaded", "BlockCache", "Dynarec" };
+
+	for (int e = 0; e <= (int)CPUEngine::Dynarec; e++) {
+		CPU cpu{ (CPUEngine)e };
+		MockBus bus(&cpu);
+		copy(begin(program), end(program), bus.memory.begin() + 0x100);
+		cpu.attachBus(&bus);
+		cpu.runUntil(100);
+
+		EXPECT_TRUE(cpu.isStopped()) << names[e];
+		vector<pair<u16, u8>> expected = { { 0xC000, 0x42 }, { 0xC000, 0x43 }, { 0xFF80, 0x43 } };
+		EXPECT_EQ(bus.writes, expected) << names[e];
+		EXPECT_EQ(count(bus.reads.begin(), bus.reads.end(), 0xC000), 2) << names[e];
+		EXPECT_EQ(count(bus.reads.begin(), bus.reads.end(), 0x0100), 1) << names[e];
+	}
+}
@@ -0,0 +1,60 @@
+#include "pch.h"
+
+#include <vector>
+
+#include "CPU.h"
+#include "Bus.h"
+#include "PPU.h"
+
+using namespace std;
+
+class NullDisplay : public Display {
+public:
+	void drawScanline(u8 row, span<const u8> colours) override {}
+};
+
+struct PPUSystem {
+	NullDisplay display;
+	PPU ppu;
+	CPU cpu;
+	Bus bus{ &cpu, &ppu, &display, vector<u8>(0x8000, 0) };
+
+	PPUSystem() {
+		cpu.attachBus(&bus);
+		ppu.attachBus(&bus);
+		bus.write(0xFF40, 0x91); // LCD and background on
+		bus.write(0xFF45, 153);  // LYC on the last VBlank line
+	}
+};
+
+// advanceTo has to leave LY, STAT and IF exactly where stepping every tick
+// does, checked after every `stride` ticks over two frames
+void compareWithStep(u64 stride) {
+	PPUSystem stepped, events;
+	const u64 ticks = 2 * 154 * 114;
+	bool steppedFrame = false, sawLastLine = false;
+	for (u64 clock = 1; clock <= ticks; clock++) {
+		stepped.ppu.step();
+		steppedFrame |= stepped.ppu.isDoneFrame();
+		if (clock % stride != 0) continue;
+
+		bool eventsFrame = events.ppu.advanceTo(clock);
+		ASSERT_EQ(events.ppu.getCycle(), clock);
+		ASSERT_EQ(events.bus.read(0xFF44), stepped.bus.read(0xFF44)) << "LY at " << clock;
+		ASSERT_EQ(events.bus.read(0xFF41), stepped.bus.read(0xFF41)) << "STAT at " << clock;
+		ASSERT_EQ(events.bus.read(0xFF0F), stepped.bus.read(0xFF0F)) << "IF at " << clock;
+		ASSERT_EQ(eventsFrame, steppedFrame) << "frame at " << clock;
+		steppedFrame = false;
+		sawLastLine |= stepped.bus.read(0xFF44) == 153;
+	}
+	EXPECT_TRUE(sawLastLine);
+}
+
+TEST(PPUEvents, AdvanceToMatchesStepEveryTick) {
+	compareWithStep(1);
+}
+
+TEST(PPUEvents, AdvanceToMatchesStepInSlices) {
+	compareWithStep(7);
+	compareWithStep(114);
+}
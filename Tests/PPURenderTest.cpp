@@ -0,0 +1,75 @@
+#include "pch.h"
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "CPU.h"
+#include "Bus.h"
+#include "PPU.h"
+
+using namespace std;
+
+// Counts every allocation in the test binary, see PPURender.NoAllocations
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+	allocations++;
+	void* p = malloc(size ? size : 1);
+	if (p == nullptr) throw bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
+class LineCountDisplay : public Display {
+public:
+	int lines = 0;
+	void drawScanline(u8 row, span<const u8> colours) override { lines++; }
+};
+
+// Two frames with the background on, a fine scroll and tiles rewritten in
+// between, so the tile cache is refreshed too
+TEST(PPURender, NoAllocations) {
+	LineCountDisplay display;
+	PPU ppu;
+	CPU cpu;
+	Bus bus(&cpu, &ppu, &display, vector<u8>(0x8000, 0));
+	cpu.attachBus(&bus);
+	ppu.attachBus(&bus);
+	bus.write(0xFF40, 0x91); // LCD and background on, signed tile indices (tiles 128-383)
+	bus.write(0xFF43, 3);    // SCX
+	bus.write(0xFF47, 0xE4); // BGP, colour n is shade n
+	// A different tile for each column of the top map row, both halves of the signed range
+	for (u16 column = 0; column < 32; column++) bus.write(0x9800 + column, (u8)(column * 9 + 1));
+
+	const int frameSteps = 154 * 114;
+	for (int i = 0; i < frameSteps; i++) ppu.step();
+
+	allocations = 0;
+	display.lines = 0;
+	for (int frame = 0; frame < 2; frame++) {
+		// 141 is odd, so no two of the 256 tiles a map can reach hold the same bytes
+		for (u16 addr = 0x8000; addr < 0x9800; addr++) bus.write(addr, (u8)((addr >> 4) * 141 + addr * 7 + frame));
+		for (int i = 0; i < frameSteps; i++) ppu.step();
+	}
+	EXPECT_EQ(allocations, 0);
+	EXPECT_EQ(display.lines, 2 * 144);
+
+	// Line 0 is the top row of the tiles in map row 0, scrolled left by 3
+	const u8* line = ppu.getFrameBuffer();
+	for (int i = 0; i < 160; i++) {
+		int x = i + 3;
+		u8 index = bus.read(0x9800 + x / 8);
+		u16 tile = 128 + (s8)index;
+		u8 low = bus.read(0x8000 + tile * 16), high = bus.read(0x8000 + tile * 16 + 1);
+		int bit = 7 - x % 8;
+		ASSERT_EQ(line[i], (low >> bit & 1) | (high >> bit & 1) << 1) << "pixel " << i;
+	}
+}
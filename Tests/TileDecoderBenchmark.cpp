@@ -0,0 +1,81 @@
+#include "pch.h"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <span>
+
+#include "TileDecoder.h"
+
+using namespace std;
+
+// The per-pixel decoder the PPU used before TileDecoder, kept as the baseline
+static void tileToRowColours(span<const u8> tile, u8 rowNum, vector<u8>* out) {
+	auto first = tile[rowNum * 2];
+	auto second = tile[rowNum * 2 + 1];
+	u8 ptr = 0x80;
+	for (int i = 7; i >= 0; i--) {
+		u8 colour = (((second & ptr) >> i) << 1) | ((first & ptr) >> i);
+		ptr >>= 1;
+		out->emplace_back(colour);
+	}
+}
+
+static const char* decoderNames[] = { "Scalar", "SSE2", "AVX2" };
+
+// One tile map row: a row of each of 32 tiles, as the background needs per
+// scanline. Pixels are checked against the baseline run through BGP.
+static vector<u8> mapRowPlanes() {
+	vector<u8> planes(64);
+	for (int i = 0; i < 64; i++) planes[i] = (u8)(i * 37 + 11);
+	return planes;
+}
+
+static void baselineMapRow(const vector<u8>& planes, vector<u8>& out) {
+	out.clear();
+	for (int tile = 0; tile < 32; tile++) {
+		tileToRowColours(span(planes).subspan(tile * 2, 2), 0, &out);
+	}
+}
+
+static void applyPalette(vector<u8>& pixels, u8 bgp) {
+	for (u8& pixel : pixels) pixel = bgp >> (pixel * 2) & 0x3;
+}
+
+TEST(TileDecoder, MapRowMatchesBaseline) {
+	const u8 bgp = 0xE1;
+	vector<u8> planes = mapRowPlanes();
+	vector<u8> expected;
+	baselineMapRow(planes, expected);
+	applyPalette(expected, bgp);
+	for (int d = 0; d <= (int)bestTileDecoder(); d++) {
+		vector<u8> pixels(256);
+		decodeTileRows(planes.data(), 32, bgp, pixels.data(), (TileDecoder)d);
+		EXPECT_EQ(pixels, expected) << decoderNames[d];
+	}
+}
+
+// Timing only, run with --gtest_also_run_disabled_tests
+TEST(TileDecoderBenchmark, DISABLED_MapRow) {
+	const int passes = 200000;
+	const u8 bgp = 0xE1;
+	vector<u8> planes = mapRowPlanes();
+
+	vector<u8> expected;
+	auto start = chrono::steady_clock::now();
+	for (int pass = 0; pass < passes; pass++) baselineMapRow(planes, expected);
+	double baseline = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	applyPalette(expected, bgp);
+	cout << "tileToRowColours: " << (baseline / passes * 1e9) << " ns/row" << endl;
+
+	for (int d = 0; d <= (int)bestTileDecoder(); d++) {
+		vector<u8> pixels(256);
+		start = chrono::steady_clock::now();
+		for (int pass = 0; pass < passes; pass++) {
+			decodeTileRows(planes.data(), 32, bgp, pixels.data(), (TileDecoder)d);
+		}
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		EXPECT_EQ(pixels, expected) << decoderNames[d];
+		cout << decoderNames[d] << ": " << (seconds / passes * 1e9) << " ns/row" << endl;
+	}
+}